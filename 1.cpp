@@ -1,684 +1,708 @@
-
-
-#include <iostream>
-#include <vector>
-#include <string>
-#include <cmath>
-#include <cstdlib>
-#include <ctime>
-#include <map>
-#include <iomanip>
-#include <algorithm>
-#include <unistd.h>
+#include "simulator.h"
 
 using namespace std;
 
-class Location {
-private:
-    double x, y;
-
-public:
-    Location(double x = 0, double y = 0) : x(x), y(y) {}
-    
-    double getX() const { return x; }
-    double getY() const { return y; }
-    
-    double distanceTo(const Location& other) const {
-        return sqrt(pow(x - other.x, 2) + pow(y - other.y, 2));
-    }
-    
-    string toString() const {
-        return "(" + to_string((int)x) + "," + to_string((int)y) + ")";
-    }
+struct BatchOptions {
+    int drivers = 1000;
+    int riders = 500;
+    int ticks = -1;
+    int requestsPerTick = -1;
+    int threads = 1;
+    int shards = 1;
+    bool eventEngine = false;
+    int dispatchWindow = 0;
+    int candidates = 8;
+    uint64_t seed = time(0);
+    string scenario;
+    string schedule;
+    int ticksPerHour = 60;
+    string journalPath;
+    string archivePath;
+    string resumePath;
+    string checkpointPath;
+    string tracePath;
+    string roadsPath;
+    string roadCachePath;
+    int distanceCache = 0;
+    double cacheCell = 0.5;
+    int hotZones = 0;
+    string metricsPath;
+    int metricsInterval = 1000;
+    double serveSeconds = 0;
+    int producers = 4;
+    double rate = 0;
+    string listenPath;
+    int tickMillis = 10;
+    int batchSize = 256;
+    double zoneSize = 0;
+    bool reposition = false;
+    string exportPrefix;
+    bool columnarExport = false;
+    int exportEvery = 0;
+    bool verbose = false;
 };
 
-class Driver {
-public:
-    enum Status { OFFLINE, AVAILABLE, ON_TRIP };
-    
-private:
-    int id;
-    string name;
-    Location location;
-    Status status;
-    string vehicleType;
-    string licensePlate;
-    double earnings;
-    double rating;
-    int totalTrips;
+void printUsage(const char* program) {
+    cout << "Usage: " << program << " [--batch [options] | --sweep [options]]\n"
+         << "  (no arguments)        interactive menu\n"
+         << "  --batch               headless run, prints a final summary\n"
+         << "    --drivers N         fleet size (default 1000)\n"
+         << "    --riders M          rider count (default 500)\n"
+         << "    --ticks K           simulation ticks (default 1000, or the whole trace with --trace)\n"
+         << "    --requests R        ride requests per tick (default riders/20)\n"
+         << "    --threads T         worker threads for the tick engine (default 1)\n"
+         << "    --shards N          split the map into N strips, each simulated on its own thread (default 1)\n"
+         << "    --engine NAME       tick (default) | event\n"
+         << "    --dispatch-window W match pending requests together every W ticks (default 0: on arrival)\n"
+         << "    --candidates K      nearest drivers considered per request in a window (default 8)\n"
+         << "    --scenario NAME     rush-hour | moderate | late-night | weekend\n"
+         << "    --schedule SPEC     Poisson demand following a time-of-day curve instead of --requests:\n"
+         << "                        day, or hour:scenario keyframes such as 0:late-night,8:rush-hour,11:moderate\n"
+         << "    --ticks-per-hour N  simulated ticks per hour of the schedule (default 60)\n"
+         << "    --seed S            random seed; the same seed replays the same run\n"
+         << "    --journal FILE      write every event as a CSV record to FILE\n"
+         << "    --archive FILE      spill completed-ride chunks to FILE (default: a temporary file)\n"
+         << "    --resume FILE       continue from a snapshot; fleet, seed, engine, dispatch, surge,\n"
+         << "                        schedule and zones come from it\n"
+         << "    --checkpoint FILE   write a snapshot after the run\n"
+         << "    --trace FILE        replay ride requests from a CSV or binary trip trace instead of --requests\n"
+         << "    --roads FILE        measure fares and pickups on a road graph and drive along its edges\n"
+         << "    --road-cache FILE   keep the road graph's landmark tables in FILE between runs\n"
+         << "    --distance-cache N  cache up to N cell-to-cell road distances (default 0: off; needs --roads)\n"
+         << "    --cache-cell W      width of a distance-cache cell in map units (default 0.5)\n"
+         << "    --hot-zones Z       precompute distances among the Z cells with the most riders\n"
+         << "    --metrics FILE      rewrite per-phase timers to FILE as Prometheus text (JSON if FILE ends in .json)\n"
+         << "    --metrics-interval MS  how often --metrics is rewritten, in wall-clock ms (default 1000)\n"
+         << "    --serve SECONDS     service mode: take requests from threads for SECONDS of wall time while ticking\n"
+         << "    --producers P       load-generator threads submitting random trips (default 4; 0 for --listen only)\n"
+         << "    --rate R            requests/s offered by all producers together (default 0: as fast as accepted)\n"
+         << "    --listen PATH       also read \"px,py,dx,dy[,vehicle]\" lines from the named pipe PATH (created if missing)\n"
+         << "    --tick-ms MS        wall-clock time between ticks in service mode (default 10)\n"
+         << "    --batch-size N      requests the dispatcher matches per lock (default 256)\n"
+         << "    --zones W           price each pickup by supply and demand in W-wide zones (default 0: flat surge)\n"
+         << "    --reposition        move idle drivers toward neighbouring zones short of drivers (needs --zones)\n"
+         << "    --export PREFIX     write drivers, riders, active and completed rides to PREFIX<table>.csv after the run\n"
+         << "    --export-format F   csv (default) | columnar (.col files)\n"
+         << "    --export-every K    also export every K ticks, to PREFIXtick<N>-<table>\n"
+         << "    --verbose           narrate every event on the console\n"
+         << "  --sweep               run a grid of independent simulations in parallel, prints a results table\n"
+         << "    --scenarios A,B,... rush-hour, moderate, late-night, weekend or day (default: the four scenarios)\n"
+         << "    --drivers N,M,...   fleet sizes (default 1000)\n"
+         << "    --riders N,M,...    rider counts (default 500)\n"
+         << "    --seeds A-B|A,B,... seeds per grid cell (default 1-10)\n"
+         << "    --ticks K           ticks per run (default 1000)\n"
+         << "    --ticks-per-hour N  simulated ticks per hour of the day schedule (default 60)\n"
+         << "    --jobs J            runs in parallel (default: one per core)\n"
+         << "    --output FILE       also write one CSV row per run to FILE\n";
+}
 
-public:
-    Driver(int id, string name, Location loc, string vehicle, string plate) 
-        : id(id), name(name), location(loc), status(OFFLINE), vehicleType(vehicle), 
-          licensePlate(plate), earnings(0.0), rating(5.0), totalTrips(0) {}
-    
-    int getId() const { return id; }
-    string getName() const { return name; }
-    Location getLocation() const { return location; }
-    Status getStatus() const { return status; }
-    string getVehicleType() const { return vehicleType; }
-    string getLicensePlate() const { return licensePlate; }
-    double getEarnings() const { return earnings; }
-    double getRating() const { return rating; }
-    int getTotalTrips() const { return totalTrips; }
-    
-    void setLocation(Location loc) { location = loc; }
-    
-    string getStatusString() const {
-        switch(status) {
-            case OFFLINE: return "OFFLINE";
-            case AVAILABLE: return "AVAILABLE";
-            case ON_TRIP: return "ON_TRIP";
-            default: return "UNKNOWN";
+bool parseBatchOptions(int argc, char* argv[], BatchOptions& options) {
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--verbose") {
+            options.verbose = true;
+            continue;
         }
-    }
-    
-    void goOnline() { 
-        status = AVAILABLE; 
-        cout << " Driver " << name << " is now ONLINE at location " << location.toString() << endl;
-    }
-    
-    void goOffline() { 
-        status = OFFLINE; 
-        cout << " Driver " << name << " is now OFFLINE" << endl;
-    }
-    
-    void startTrip() { 
-        status = ON_TRIP; 
-        cout << "Driver " << name << " started a trip" << endl;
-    }
-    
-    void endTrip(double payment, double newRating) {
-        status = AVAILABLE;
-        earnings += payment;
-        rating = (rating * totalTrips + newRating) / (totalTrips + 1);
-        totalTrips++;
-        cout << " Driver " << name << " earned ₹" << payment << " | New rating: " << fixed << setprecision(1) << rating << endl;
-    }
-    
-    void moveTowards(Location target) {
-        double dx = target.getX() - location.getX();
-        double dy = target.getY() - location.getY();
-        double distance = sqrt(dx * dx + dy * dy);
-        
-        if (distance > 0.1) {
-            location = Location(
-                location.getX() + (dx / distance) * 0.5,
-                location.getY() + (dy / distance) * 0.5
-            );
-        } else {
-            location = target;
+        if (arg == "--reposition") {
+            options.reposition = true;
+            continue;
         }
-    }
-};
-
-class Rider {
-private:
-    int id;
-    string name;
-    Location location;
-    bool hasActiveRide;
-    double balance;
-
-public:
-    Rider(int id, string name, Location loc) 
-        : id(id), name(name), location(loc), hasActiveRide(false), balance(1000.0) {}
-    
-    int getId() const { return id; }
-    string getName() const { return name; }
-    Location getLocation() const { return location; }
-    bool hasRide() const { return hasActiveRide; }
-    double getBalance() const { return balance; }
-    
-    void setRideStatus(bool status) { hasActiveRide = status; }
-    void setLocation(Location loc) { location = loc; }
-    
-    void pay(double amount) { 
-        balance -= amount; 
-        cout  << name << " paid ₹" << amount << " | Remaining balance: ₹" << balance << endl;
-    }
-    
-    void addBalance(double amount) { 
-        balance += amount; 
-        cout  << name << " added ₹" << amount << " to wallet" << endl;
-    }
-};
-
-class Ride {
-public:
-    enum RideStatus { REQUESTED, DRIVER_ASSIGNED, PICKUP_REACHED, IN_PROGRESS, COMPLETED, CANCELLED };
-
-private:
-    int id;
-    Rider* rider;
-    Driver* driver;
-    Location pickup;
-    Location destination;
-    RideStatus status;
-    double fare;
-    double distance;
-
-public:
-    Ride(int id, Rider* rider, Location pickup, Location destination)
-        : id(id), rider(rider), driver(nullptr), pickup(pickup), 
-          destination(destination), status(REQUESTED), fare(0.0) {
-        calculateFare();
-    }
-    
-    int getId() const { return id; }
-    Rider* getRider() const { return rider; }
-    Driver* getDriver() const { return driver; }
-    Location getPickup() const { return pickup; }
-    Location getDestination() const { return destination; }
-    RideStatus getStatus() const { return status; }
-    double getFare() const { return fare; }
-    double getDistance() const { return distance; }
-    
-    string getStatusString() const {
-        switch(status) {
-            case REQUESTED: return "REQUESTED";
-            case DRIVER_ASSIGNED: return "DRIVER_ASSIGNED";
-            case PICKUP_REACHED: return "PICKUP_REACHED";
-            case IN_PROGRESS: return "IN_PROGRESS";
-            case COMPLETED: return "COMPLETED";
-            case CANCELLED: return "CANCELLED";
-            default: return "UNKNOWN";
+        if (i + 1 >= argc) {
+            cout << " Missing value for " << arg << endl;
+            return false;
         }
-    }
-    
-    void assignDriver(Driver* drv) {
-        driver = drv;
-        status = DRIVER_ASSIGNED;
-        driver->startTrip();
-        rider->setRideStatus(true);
-        
-        cout << "Ride #" << id << " assigned to " << driver->getName() 
-             << " (" << driver->getVehicleType() << ")" << endl;
-        cout << " Pickup: " << pickup.toString() << " → Destination: " << destination.toString() << endl;
-        cout << " Fare: ₹" << fixed << setprecision(2) << fare << " | Distance: " << distance << " km" << endl;
-    }
-    
-    void update() {
-        if (!driver || status == COMPLETED || status == CANCELLED) return;
-        
-        switch(status) {
-            case DRIVER_ASSIGNED:
-                if (driver->getLocation().distanceTo(pickup) < 1.0) {
-                    status = PICKUP_REACHED;
-                    cout << " Driver " << driver->getName() << " reached pickup point for " << rider->getName() << endl;
-                } else {
-                    driver->moveTowards(pickup);
-                }
-                break;
-                
-            case PICKUP_REACHED:
-                status = IN_PROGRESS;
-                cout << " Ride #" << id << " started! " << rider->getName() << " is on the way" << endl;
-                break;
-                
-            case IN_PROGRESS:
-                if (driver->getLocation().distanceTo(destination) < 1.0) {
-                    completeRide();
-                } else {
-                    driver->moveTowards(destination);
-                }
-                break;
+        string value = argv[++i];
+        if (arg == "--scenario") {
+            options.scenario = value;
+            continue;
+        }
+        if (arg == "--schedule") {
+            options.schedule = value;
+            continue;
+        }
+        if (arg == "--engine") {
+            if (value != "tick" && value != "event") {
+                cout << " Unknown engine: " << value << endl;
+                return false;
+            }
+            options.eventEngine = value == "event";
+            continue;
+        }
+        if (arg == "--seed") {
+            char* end = nullptr;
+            options.seed = strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0') {
+                cout << " Invalid value for --seed: " << value << endl;
+                return false;
+            }
+            continue;
+        }
+        if (arg == "--journal") {
+            options.journalPath = value;
+            continue;
+        }
+        if (arg == "--archive") {
+            options.archivePath = value;
+            continue;
+        }
+        if (arg == "--resume") {
+            options.resumePath = value;
+            continue;
+        }
+        if (arg == "--checkpoint") {
+            options.checkpointPath = value;
+            continue;
+        }
+        if (arg == "--trace") {
+            options.tracePath = value;
+            continue;
+        }
+        if (arg == "--roads") {
+            options.roadsPath = value;
+            continue;
+        }
+        if (arg == "--road-cache") {
+            options.roadCachePath = value;
+            continue;
+        }
+        if (arg == "--cache-cell") {
+            options.cacheCell = atof(value.c_str());
+            if (options.cacheCell <= 0) {
+                cout << " Invalid value for --cache-cell: " << value << endl;
+                return false;
+            }
+            continue;
+        }
+        if (arg == "--export") {
+            options.exportPrefix = value;
+            continue;
+        }
+        if (arg == "--export-format") {
+            if (value != "csv" && value != "columnar") {
+                cout << " Unknown export format: " << value << endl;
+                return false;
+            }
+            options.columnarExport = value == "columnar";
+            continue;
+        }
+        if (arg == "--zones") {
+            options.zoneSize = atof(value.c_str());
+            if (options.zoneSize <= 0) {
+                cout << " Invalid value for --zones: " << value << endl;
+                return false;
+            }
+            continue;
+        }
+        if (arg == "--metrics") {
+            options.metricsPath = value;
+            continue;
+        }
+        if (arg == "--listen") {
+            options.listenPath = value;
+            continue;
+        }
+        if (arg == "--serve" || arg == "--rate") {
+            double seconds = atof(value.c_str());
+            if (seconds < 0 || (seconds == 0 && arg == "--serve")) {
+                cout << " Invalid value for " << arg << ": " << value << endl;
+                return false;
+            }
+            (arg == "--serve" ? options.serveSeconds : options.rate) = seconds;
+            continue;
+        }
+        int number = atoi(value.c_str());
+        if (number < 0 || (number == 0 && value != "0")) {
+            cout << " Invalid value for " << arg << ": " << value << endl;
+            return false;
+        }
+        if (arg == "--drivers") options.drivers = number;
+        else if (arg == "--riders") options.riders = number;
+        else if (arg == "--ticks") options.ticks = number;
+        else if (arg == "--requests") options.requestsPerTick = number;
+        else if (arg == "--threads") options.threads = max(1, number);
+        else if (arg == "--shards") options.shards = max(1, number);
+        else if (arg == "--producers") options.producers = number;
+        else if (arg == "--tick-ms") options.tickMillis = max(1, number);
+        else if (arg == "--batch-size") options.batchSize = max(1, number);
+        else if (arg == "--dispatch-window") options.dispatchWindow = number;
+        else if (arg == "--candidates") options.candidates = max(1, number);
+        else if (arg == "--metrics-interval") options.metricsInterval = max(1, number);
+        else if (arg == "--ticks-per-hour") options.ticksPerHour = max(1, number);
+        else if (arg == "--distance-cache") options.distanceCache = number;
+        else if (arg == "--hot-zones") options.hotZones = number;
+        else if (arg == "--export-every") options.exportEvery = number;
+        else {
+            cout << " Unknown option: " << arg << endl;
+            return false;
         }
     }
-    
-    void completeRide() {
-        status = COMPLETED;
-        rider->pay(fare);
-        driver->endTrip(fare, 5.0); 
-        rider->setRideStatus(false);
-        rider->setLocation(destination);
-        
-        cout << "Ride #" << id << " completed! " << rider->getName() 
-             << " reached destination" << endl;
+    // A resumed run takes its rider count, and so this default, from the snapshot.
+    if (options.requestsPerTick < 0 && options.resumePath.empty()) {
+        options.requestsPerTick = max(1, options.riders / 20);
     }
-    
-    void cancelRide() {
-        status = CANCELLED;
-        if (driver) {
-            driver->goOnline();
-        }
-        rider->setRideStatus(false);
-        cout << " Ride #" << id << " cancelled" << endl;
+    if (options.ticks < 0 && options.tracePath.empty()) {
+        options.ticks = 1000;
     }
-
-private:
-    void calculateFare() {
-        distance = pickup.distanceTo(destination);
-        fare = distance * 8.0 + 20.0; 
+    if (options.reposition && options.zoneSize <= 0) {
+        cout << " --reposition needs --zones" << endl;
+        return false;
     }
-};
+    if (options.exportEvery > 0 && options.exportPrefix.empty()) {
+        cout << " --export-every needs --export" << endl;
+        return false;
+    }
+    return true;
+}
 
-class RideSharingSimulator {
-private:
-    vector<Rider*> riders;
-    vector<Driver*> drivers;
-    vector<Ride*> activeRides;
-    vector<Ride*> completedRides;
-    
-    int nextRiderId;
-    int nextDriverId;
-    int nextRideId;
-    
-   
-    map<string, map<string, double>> scenarios;
+// A sharded run covers the request/match/ride loop. The options it turns down
+// act on a single simulator's journal, snapshot, trace cursor or road graph,
+// or on the event engine and dispatch windows, which shards do not run.
+int runShardedBatch(const BatchOptions& options) {
+    const char* unsupported = nullptr;
+    if (options.eventEngine) unsupported = "--engine event";
+    else if (options.dispatchWindow > 0) unsupported = "--dispatch-window";
+    else if (!options.resumePath.empty()) unsupported = "--resume";
+    else if (!options.checkpointPath.empty()) unsupported = "--checkpoint";
+    else if (!options.tracePath.empty()) unsupported = "--trace";
+    else if (!options.roadsPath.empty()) unsupported = "--roads";
+    else if (!options.journalPath.empty()) unsupported = "--journal";
+    else if (!options.archivePath.empty()) unsupported = "--archive";
+    else if (!options.metricsPath.empty()) unsupported = "--metrics";
+    else if (!options.exportPrefix.empty()) unsupported = "--export";
+    else if (options.verbose) unsupported = "--verbose";
+    else if (options.serveSeconds > 0) unsupported = "--serve";
+    if (unsupported) {
+        cout << " " << unsupported << " cannot be combined with --shards" << endl;
+        return 1;
+    }
+    
+    ShardedSimulation simulation(options.shards, options.riders, options.drivers, options.seed);
+    if (!options.scenario.empty()) {
+        simulation.setScenario(options.scenario);
+    }
+    simulation.setZones(options.zoneSize, options.reposition);
+    if (!options.schedule.empty() && !simulation.setSchedule(options.schedule, options.ticksPerHour)) {
+        cout << " Invalid schedule: " << options.schedule << endl;
+        return 1;
+    }
+    
+    cout << "Batch run: " << options.drivers << " drivers, " << options.riders << " riders, ";
+    if (!options.schedule.empty()) {
+        cout << options.ticks << " ticks, schedule " << options.schedule << " at " << options.ticksPerHour << " ticks/hour, ";
+    } else {
+        cout << options.ticks << " ticks, " << options.requestsPerTick << " requests/tick, ";
+    }
+    cout << options.shards << " shards, seed " << options.seed << "\n";
+    
+    auto start = chrono::steady_clock::now();
+    long requested = options.schedule.empty() ? simulation.runTicks(options.ticks, options.requestsPerTick)
+                                              : simulation.runScheduledTicks(options.ticks);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long ticks = simulation.getCurrentTick();
+    
+    cout << "\n BATCH RUN SUMMARY:\n";
+    cout << "==========================================\n";
+    cout << "Ticks: " << ticks << " | Requests attempted: " << requested << endl;
+    cout << "Wall time: " << fixed << setprecision(3) << seconds << " s";
+    if (seconds > 0) {
+        cout << " | " << setprecision(1) << ticks / seconds << " ticks/s | " 
+             << simulation.getStats().getCompletedRides() / seconds << " rides/s";
+    }
+    cout << endl;
+    simulation.showStatistics();
+    return 0;
+}
 
-public:
-    RideSharingSimulator() : nextRiderId(1), nextDriverId(1), nextRideId(1) {
-        srand(time(0));
-        initializeScenarios();
-        initializeSampleData();
-        setInitialDriversOnline(); 
-    }
-    
-    ~RideSharingSimulator() {
-        for (auto rider : riders) delete rider;
-        for (auto driver : drivers) delete driver;
-        for (auto ride : activeRides) delete ride;
-        for (auto ride : completedRides) delete ride;
+// Load generator for --serve. Each producer submits random trips, paced so that
+// together they offer options.rate requests/s, or as fast as the queue accepts
+// them when no rate is set.
+RideService::Report serveRequests(RideSharingSimulator& simulator, const BatchOptions& options) {
+    RideService service(simulator, 65536, options.batchSize, options.tickMillis);
+    if (!options.listenPath.empty()) service.listen(options.listenPath);
+    service.start();
+    
+    auto deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                        chrono::duration<double>(options.serveSeconds));
+    vector<thread> producers;
+    for (int p = 0; p < options.producers; p++) {
+        producers.emplace_back([&, p] {
+            RandomStream rng(options.seed, 1000 + p);
+            auto gap = chrono::duration_cast<chrono::steady_clock::duration>(
+                           chrono::duration<double>(options.rate > 0 ? options.producers / options.rate : 0.0));
+            auto next = chrono::steady_clock::now();
+            while (chrono::steady_clock::now() < deadline) {
+                Location pickup(rng.nextDouble() * 18 + 1, rng.nextDouble() * 18 + 1);
+                Location destination(rng.nextDouble() * 18 + 1, rng.nextDouble() * 18 + 1);
+                bool accepted = service.submit(pickup, destination);
+                if (options.rate > 0) {
+                    next += gap;
+                    this_thread::sleep_until(next);
+                } else if (!accepted) {
+                    this_thread::yield();
+                }
+            }
+        });
     }
+    this_thread::sleep_until(deadline);
+    for (thread& producer : producers) producer.join();
+    service.stop();
+    return service.getReport();
+}
 
-private:
-    void initializeScenarios() {
-        scenarios["rush-hour"] = {{"driver_online_rate", 0.8}, {"ride_request_rate", 0.7}, {"surge", 1.5}};
-        scenarios["moderate"] = {{"driver_online_rate", 0.6}, {"ride_request_rate", 0.4}, {"surge", 1.0}};
-        scenarios["late-night"] = {{"driver_online_rate", 0.3}, {"ride_request_rate", 0.2}, {"surge", 2.0}};
-        scenarios["weekend"] = {{"driver_online_rate", 0.7}, {"ride_request_rate", 0.6}, {"surge", 1.3}};
+int runBatchMode(int argc, char* argv[]) {
+    BatchOptions options;
+    if (!parseBatchOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.shards > 1) {
+        return runShardedBatch(options);
+    }
+    if (options.serveSeconds > 0 && (!options.tracePath.empty() || options.dispatchWindow > 0)) {
+        cout << " --serve cannot be combined with " << (options.dispatchWindow > 0 ? "--dispatch-window" : "--trace") << endl;
+        return 1;
+    }
+    if (!options.listenPath.empty() && options.serveSeconds <= 0) {
+        cout << " --listen needs --serve" << endl;
+        return 1;
+    }
+    
+    // Per-event text would dominate a large run, so it is only produced when asked for.
+    bool resuming = !options.resumePath.empty();
+    RideSharingSimulator simulator(resuming ? 0 : options.riders, resuming ? 0 : options.drivers,
+                                   options.verbose ? EventJournal::NARRATED : EventJournal::QUIET, options.seed);
+    EventJournal& journal = simulator.getJournal();
+    simulator.setThreadCount(options.threads);
+    if (resuming) {
+        auto loadStart = chrono::steady_clock::now();
+        if (!simulator.loadSnapshot(options.resumePath)) {
+            cout << " Not a valid snapshot: " << options.resumePath << endl;
+            return 1;
+        }
+        double loadMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+        options.drivers = simulator.getDriverCount();
+        options.riders = simulator.getRiderCount();
+        if (options.requestsPerTick < 0) options.requestsPerTick = max(1, options.riders / 20);
+        options.seed = simulator.getSeed();
+        options.eventEngine = simulator.getEngine() == RideSharingSimulator::EVENT_ENGINE;
+        if (options.schedule.empty() && !simulator.getSchedule().empty()) {
+            options.schedule = simulator.getSchedule().describe();
+            options.ticksPerHour = simulator.getSchedule().getTicksPerHour();
+        }
+        cout << "Resumed " << options.resumePath << " at tick " << simulator.getCurrentTick() 
+             << " in " << fixed << setprecision(1) << loadMillis << " ms\n";
+    } else {
+        simulator.setEngine(options.eventEngine ? RideSharingSimulator::EVENT_ENGINE : RideSharingSimulator::TICK_ENGINE);
+        simulator.setDispatchWindow(options.dispatchWindow, options.candidates);
     }
-    
-    void initializeSampleData() {
-        cout << " INITIALIZING RIDE-SHARING SIMULATOR...\n\n";
-        
-        
-        riders.push_back(new Rider(nextRiderId++, "Aarav Sharma", Location(5, 5)));
-        riders.push_back(new Rider(nextRiderId++, "Priya Patel", Location(15, 8)));
-        riders.push_back(new Rider(nextRiderId++, "Rohan Singh", Location(8, 15)));
-        riders.push_back(new Rider(nextRiderId++, "Neha Gupta", Location(12, 3)));
-        riders.push_back(new Rider(nextRiderId++, "Vikram Joshi", Location(3, 12)));
-        
-        
-        for (int i = 0; i < 15; i++) {
-            Location randomLoc(rand() % 18 + 1, rand() % 18 + 1);
-            string vehicles[] = {"Sedan", "Hatchback", "SUV", "Premium"};
-            string plates[] = {"DL01AB", "MH02CD", "KA03EF", "TN04GH", "UP05IJ"};
-            
-            drivers.push_back(new Driver(
-                nextDriverId++, 
-                "Driver " + to_string(i+1),
-                randomLoc,
-                vehicles[rand() % 4],
-                plates[rand() % 5] + to_string(rand() % 1000)
-            ));
-        }
-        
-        cout << "Created " << riders.size() << " riders and " << drivers.size() << " drivers\n";
+    if (!options.journalPath.empty() && !journal.openRecordFile(options.journalPath)) {
+        cout << " Cannot open journal file: " << options.journalPath << endl;
+        return 1;
     }
-    
-    void setInitialDriversOnline() {
-        cout << "\n SETTING INITIAL DRIVERS ONLINE...\n";
-        int onlineCount = 0;
-       
-        for (Driver* driver : drivers) {
-            if (rand() % 100 < 60) { 
-                driver->goOnline();
-                onlineCount++;
-            }
-        }
-        cout << onlineCount << " drivers are now online and available\n";
+    if (!options.archivePath.empty() && !simulator.getArchive().openSpillFile(options.archivePath)) {
+        cout << " Cannot open archive file: " << options.archivePath << endl;
+        return 1;
     }
-    
-    Location randomLocation() {
-        return Location(rand() % 18 + 1, rand() % 18 + 1);
+    if (!options.scenario.empty() && !resuming) {
+        simulator.setScenario(options.scenario);
     }
     
-    void setScenario(string scenarioName) {
-        if (scenarios.find(scenarioName) == scenarios.end()) {
-            cout << " Unknown scenario: " << scenarioName << endl;
-            return;
-        }
-        
-        auto scenario = scenarios[scenarioName];
-        
-        
-        for (Driver* driver : drivers) {
-            driver->goOffline();
-        }
-        
-       
-        int driversToGoOnline = drivers.size() * scenario["driver_online_rate"];
-        cout << "\nSETTING SCENARIO: " << scenarioName << endl;
-        cout << " Expected online drivers: " << driversToGoOnline << "/" << drivers.size() << endl;
-        cout << " Surge multiplier: " << scenario["surge"] << "x\n";
-        
-       
-        int onlineCount = 0;
-        for (int i = 0; i < driversToGoOnline && onlineCount < driversToGoOnline; i++) {
-            int driverIndex = rand() % drivers.size();
-            if (drivers[driverIndex]->getStatus() == Driver::OFFLINE) {
-                drivers[driverIndex]->goOnline();
-                onlineCount++;
-            }
-        }
-        
-        cout  << onlineCount << " drivers are now online\n";
-    }
-
-public:
-    void showAvailableDrivers() {
-        cout << "\n AVAILABLE DRIVERS:\n";
-        cout << "==========================================\n";
-        
-        int availableCount = 0;
-        for (Driver* driver : drivers) {
-            if (driver->getStatus() == Driver::AVAILABLE) {
-                cout  << driver->getName() 
-                     << " | " << driver->getVehicleType()
-                     << " | " << driver->getLicensePlate()
-                     << " | Location: " << driver->getLocation().toString()
-                     << " | Rating: " << fixed << setprecision(1) << driver->getRating() 
-                     << " | Trips: " << driver->getTotalTrips() << endl;
-                availableCount++;
-            }
+    if (!options.roadsPath.empty()) {
+        auto loadStart = chrono::steady_clock::now();
+        if (!simulator.loadRoads(options.roadsPath, options.roadCachePath)) {
+            cout << " Cannot load road network: " << options.roadsPath << endl;
+            return 1;
         }
-        
-        if (availableCount == 0) {
-            cout << " No drivers available at the moment\n";
-            cout << " Try setting a scenario or use option 7 to set drivers online\n";
+        const RoadNetwork& roads = *simulator.getRoads();
+        cout << "Road network: " << roads.getJunctionCount() << " junctions, " << roads.getRoadCount() << " roads, "
+             << roads.getLandmarkCount() << " landmarks, ready in " << fixed << setprecision(1)
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count() << " ms\n";
+        simulator.setDistanceCache(options.distanceCache, options.cacheCell, options.hotZones);
+    } else if (options.distanceCache > 0) {
+        cout << " --distance-cache needs --roads" << endl;
+        return 1;
+    }
+    if (!options.schedule.empty() && !simulator.setSchedule(options.schedule, options.ticksPerHour)) {
+        cout << " Invalid schedule: " << options.schedule << endl;
+        return 1;
+    }
+    if (!resuming || options.zoneSize > 0) simulator.setZones(options.zoneSize, options.reposition);
+    ExportFormat exportFormat = options.columnarExport ? COLUMNAR_EXPORT : CSV_EXPORT;
+    simulator.setStateExport(options.exportPrefix, exportFormat, options.exportEvery);
+    if (!options.metricsPath.empty()) {
+        const string& path = options.metricsPath;
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        simulator.setMetricsExport(path, json, options.metricsInterval);
+    }
+    
+    TripTraceReader trace;
+    if (!options.tracePath.empty() && !trace.open(options.tracePath)) {
+        cout << " Cannot open trace file: " << options.tracePath << endl;
+        return 1;
+    }
+    
+    journal.flush();
+    cout << "Batch run: " << options.drivers << " drivers, " << options.riders << " riders, ";
+    if (!options.tracePath.empty()) {
+        cout << "trace " << options.tracePath << (trace.isBinary() ? " (binary), " : " (csv), ");
+    } else if (options.serveSeconds > 0) {
+        cout << "serving " << options.serveSeconds << " s from " << options.producers << " producer(s) at ";
+        if (options.rate > 0) {
+            cout << options.rate << " requests/s, ";
         } else {
-            cout << "Total available: " << availableCount << " drivers\n";
+            cout << "full speed, ";
         }
-    }
-    
-    void showAllDrivers() {
-        cout << "\n ALL DRIVERS STATUS:\n";
-        cout << "==========================================\n";
-        
-        map<string, int> statusCount = {{"OFFLINE", 0}, {"AVAILABLE", 0}, {"ON_TRIP", 0}};
-        
-        for (Driver* driver : drivers) {
-            string status = driver->getStatusString();
-            statusCount[status]++;
-            
-            cout << " " << driver->getName() 
-                 << " | " << status
-                 << " | " << driver->getVehicleType()
-                 << " | Location: " << driver->getLocation().toString();
-            
-            if (status == "ON_TRIP") {
-                cout << " |  On Trip";
-            } else if (status == "AVAILABLE") {
-                cout << " |  Available";
-            }
-            cout << endl;
+        if (!options.listenPath.empty()) cout << "pipe " << options.listenPath << ", ";
+        cout << "a tick every " << options.tickMillis << " ms, ";
+    } else if (!options.schedule.empty()) {
+        cout << options.ticks << " ticks, schedule " << options.schedule << " at " << options.ticksPerHour << " ticks/hour, ";
+    } else {
+        cout << options.ticks << " ticks, " << options.requestsPerTick << " requests/tick, ";
+    }
+    cout << options.threads << " thread(s), " << (options.eventEngine ? "event" : "tick") << " engine, seed " << options.seed << "\n";
+    
+    auto start = chrono::steady_clock::now();
+    long startTick = simulator.getCurrentTick();
+    size_t requested = 0;
+    RideSharingSimulator::ReplayResult replay;
+    RideService::Report service;
+    if (!options.tracePath.empty()) {
+        replay = simulator.replayTrace(trace, options.ticks);
+        requested = replay.requested + replay.dropped;
+    } else if (options.serveSeconds > 0) {
+        service = serveRequests(simulator, options);
+        requested = service.submitted;
+    } else if (!options.schedule.empty()) {
+        requested = simulator.runScheduledTicks(options.ticks);
+    } else {
+        requested = simulator.runTicks(options.ticks, options.requestsPerTick);
+    }
+    journal.flush();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!options.metricsPath.empty() && !simulator.exportMetrics()) {
+        cout << " Cannot write metrics file: " << options.metricsPath << endl;
+    }
+    long ticks = simulator.getCurrentTick() - startTick;
+    
+    cout << "\n BATCH RUN SUMMARY:\n";
+    cout << "==========================================\n";
+    cout << "Ticks: " << ticks << " | Requests attempted: " << requested << endl;
+    if (!options.tracePath.empty()) {
+        cout << "Trace rows: " << trace.getRows() << " | Malformed: " << trace.getSkipped() 
+             << " | Dropped (no idle rider / off map): " << replay.dropped << endl;
+    }
+    cout << "Wall time: " << fixed << setprecision(3) << seconds << " s";
+    if (seconds > 0) {
+        cout << " | " << setprecision(1) << ticks / seconds << " ticks/s";
+    }
+    cout << endl;
+    if (options.serveSeconds > 0) {
+        cout << "Service: " << service.submitted << " accepted (" << setprecision(1) << service.submitted / seconds 
+             << " requests/s) | Rejected (queue full): " << service.rejected << " | Matched: " << service.matched 
+             << " | No driver: " << service.unmatched << " | No idle rider / off map: " << service.dropped << endl;
+        cout << "Request-to-assignment latency (us) p50/p99/max: " << setprecision(1) << service.latency.quantile(0.50)
+             << " / " << service.latency.quantile(0.99) << " / " << service.latency.getMax() << " | Batches: " 
+             << service.batches << endl;
+        if (!options.listenPath.empty()) {
+            cout << "Pipe " << options.listenPath << ": " << service.frontendLines << " requests | Malformed: " 
+                 << service.frontendMalformed << endl;
         }
-        
-        cout << "\n DRIVER SUMMARY:\n";
-        cout << " Available: " << statusCount["AVAILABLE"] << endl;
-        cout << " On Trip: " << statusCount["ON_TRIP"] << endl;
-        cout << " Offline: " << statusCount["OFFLINE"] << endl;
-        cout << " Online Rate: " << (statusCount["AVAILABLE"] + statusCount["ON_TRIP"]) * 100 / drivers.size() << "%\n";
     }
     
-    void showRiders() {
-        cout << "\n RIDERS:\n";
-        cout << "==========================================\n";
-        for (Rider* rider : riders) {
-            cout << rider->getName() 
-                 << " | Location: " << rider->getLocation().toString()
-                 << " | Balance: ₹" << fixed << setprecision(2) << rider->getBalance()
-                 << " | " << (rider->hasRide() ? "🚕 On trip" : "✅ Available") << endl;
+    const auto& dispatch = simulator.getDispatchStats();
+    if (dispatch.windows > 0) {
+        cout << "Dispatch windows: " << dispatch.windows << " | Largest batch: " << dispatch.largestBatch
+             << " | Matched: " << dispatch.matched << " | Unmatched: " << dispatch.unmatched << endl;
+        cout << "Matching latency: avg " << setprecision(3) << dispatch.totalMillis / dispatch.windows 
+             << " ms | max " << dispatch.maxMillis << " ms\n";
+    }
+    const DistanceCache& cache = simulator.getDistanceCache();
+    if (cache.enabled()) {
+        uint64_t lookups = cache.getHits() + cache.getMisses();
+        cout << "Distance cache: " << cache.getCapacity() << " entries | Hits: " << cache.getHits() 
+             << " | Misses: " << cache.getMisses() << " | Evictions: " << cache.getEvictions() 
+             << " | Hit rate: " << setprecision(1) << (lookups ? 100.0 * cache.getHits() / lookups : 0.0) << "%\n";
+    }
+    const ZoneHeatmap& zones = simulator.getZones();
+    if (zones.enabled()) {
+        cout << "Zones: " << zones.getZoneCount() << " of " << setprecision(2) << zones.getZoneSize() 
+             << " units | Peak surge: " << zones.getPeakSurge() << "x | Repositioning moves: " 
+             << simulator.getRepositionMoves() << endl;
+    }
+#ifndef RIDE_NO_METRICS
+    const PhaseMetrics& metrics = simulator.getMetrics();
+    cout << "Phase time (s):";
+    for (int p = 0; p < PhaseMetrics::PHASE_COUNT; p++) {
+        PhaseMetrics::Phase phase = (PhaseMetrics::Phase)p;
+        cout << (p ? " | " : " ") << PhaseMetrics::phaseName(p) << " " << setprecision(3) << metrics.getSeconds(phase)
+             << " (p99/tick " << metrics.getPerTick(phase).quantile(0.99) / 1e6 << " ms)";
+    }
+    cout << endl;
+#endif
+    simulator.showStatistics();
+    
+    if (!options.exportPrefix.empty()) {
+        if (simulator.getExportFailures() > 0) {
+            cout << " " << simulator.getExportFailures() << " per-tick export(s) could not be written" << endl;
         }
+        auto exportStart = chrono::steady_clock::now();
+        if (!simulator.exportState(options.exportPrefix, exportFormat)) {
+            cout << " Cannot write export: " << options.exportPrefix << endl;
+            return 1;
+        }
+        cout << "State exported to " << options.exportPrefix << "* (" << (options.columnarExport ? "columnar" : "csv") 
+             << ") in " << fixed << setprecision(1)
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - exportStart).count() << " ms\n";
+    }
+    if (!options.checkpointPath.empty()) {
+        auto saveStart = chrono::steady_clock::now();
+        if (!simulator.saveSnapshot(options.checkpointPath)) {
+            cout << " Cannot write snapshot: " << options.checkpointPath << endl;
+            return 1;
+        }
+        cout << "Snapshot written to " << options.checkpointPath << " in " << fixed << setprecision(1)
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - saveStart).count() << " ms\n";
     }
-    
-    void requestRide(int riderIndex) {
-        if (riderIndex < 0 || riderIndex >= riders.size()) {
-            cout << " Invalid rider selection!\n";
-            return;
-        }
-        
-        Rider* rider = riders[riderIndex];
-        if (rider->hasRide()) {
-            cout << rider->getName() << " already has an active ride!\n";
-            return;
-        }
-        
-        Location pickup = rider->getLocation();
-        Location destination = randomLocation();
-        
-        Ride* ride = new Ride(nextRideId++, rider, pickup, destination);
-        activeRides.push_back(ride);
-        
-        cout << "\n RIDE REQUESTED:\n";
-        cout << " From: " << rider->getName() << " at " << pickup.toString() << endl;
-        cout << " To: Random location " << destination.toString() << endl;
-        cout << " Estimated fare: ₹" << fixed << setprecision(2) << ride->getFare() << endl;
-        
-       
-        assignDriverToRide(ride);
-    }
-    
-    void assignDriverToRide(Ride* ride) {
-        Driver* nearestDriver = nullptr;
-        double minDistance = 1000.0;
-        
-        for (Driver* driver : drivers) {
-            if (driver->getStatus() == Driver::AVAILABLE) {
-                double distance = driver->getLocation().distanceTo(ride->getPickup());
-                if (distance < minDistance) {
-                    minDistance = distance;
-                    nearestDriver = driver;
+    return 0;
+}
+
+struct SweepOptions {
+    vector<string> scenarios = {"rush-hour", "moderate", "late-night", "weekend"};
+    vector<int> drivers = {1000};
+    vector<int> riders = {500};
+    vector<uint64_t> seeds;
+    int ticks = 1000;
+    int ticksPerHour = 60;
+    int jobs = max(1u, thread::hardware_concurrency());
+    string outputPath;
+};
+
+bool parseSweepOptions(int argc, char* argv[], SweepOptions& options) {
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cout << " Missing value for " << arg << endl;
+            return false;
+        }
+        string value = argv[++i];
+        stringstream list(value);
+        string item;
+        if (arg == "--scenarios") {
+            options.scenarios.clear();
+            while (getline(list, item, ',')) {
+                if (!MonteCarloSweep::knownScenario(item)) {
+                    cout << " Unknown scenario: " << item << endl;
+                    return false;
                 }
+                options.scenarios.push_back(item);
             }
+            continue;
         }
-        
-        if (nearestDriver) {
-            ride->assignDriver(nearestDriver);
-            cout << " Nearest driver: " << nearestDriver->getName() 
-                 << " (" << minDistance << " units away)\n";
-        } else {
-            cout << " No available drivers found! Ride cancelled.\n";
-            cout << " Try setting a scenario to get more drivers online\n";
-            ride->cancelRide();
-          
-            for (auto it = activeRides.begin(); it != activeRides.end(); ++it) {
-                if (*it == ride) {
-                    delete *it;
-                    activeRides.erase(it);
-                    break;
+        if (arg == "--drivers" || arg == "--riders") {
+            vector<int>& sizes = arg == "--drivers" ? options.drivers : options.riders;
+            sizes.clear();
+            while (getline(list, item, ',')) {
+                int size = atoi(item.c_str());
+                if (size <= 0) {
+                    cout << " Invalid value for " << arg << ": " << item << endl;
+                    return false;
                 }
+                sizes.push_back(size);
             }
+            continue;
         }
-    }
-    
-    void updateSimulation() {
-        
-        for (auto it = activeRides.begin(); it != activeRides.end();) {
-            Ride* ride = *it;
-            ride->update();
-            
-            if (ride->getStatus() == Ride::COMPLETED || ride->getStatus() == Ride::CANCELLED) {
-                if (ride->getStatus() == Ride::COMPLETED) {
-                    completedRides.push_back(ride);
-                } else {
-                    delete ride;
+        if (arg == "--seeds") {
+            options.seeds.clear();
+            while (getline(list, item, ',')) {
+                char* end = nullptr;
+                uint64_t first = strtoull(item.c_str(), &end, 10);
+                uint64_t last = first;
+                if (*end == '-') last = strtoull(end + 1, &end, 10);
+                if (item.empty() || *end != '\0' || last < first) {
+                    cout << " Invalid value for --seeds: " << item << endl;
+                    return false;
                 }
-                it = activeRides.erase(it);
-            } else {
-                ++it;
+                for (uint64_t seed = first; seed <= last; seed++) options.seeds.push_back(seed);
             }
+            continue;
         }
-    }
-    
-    void showActiveRides() {
-        cout << "\n ACTIVE RIDES:\n";
-        cout << "==========================================\n";
-        
-        if (activeRides.empty()) {
-            cout << "No active rides at the moment\n";
-            return;
-        }
-        
-        for (Ride* ride : activeRides) {
-            cout << "Ride #" << ride->getId() 
-                 << " | " << ride->getRider()->getName()
-                 << " → " << (ride->getDriver() ? ride->getDriver()->getName() : "No driver")
-                 << " | Status: " << ride->getStatusString()
-                 << " | Fare: ₹" << fixed << setprecision(2) << ride->getFare() << endl;
+        if (arg == "--output") {
+            options.outputPath = value;
+            continue;
         }
-    }
-    
-    void showStatistics() {
-        cout << "\n SIMULATION STATISTICS:\n";
-        cout << "==========================================\n";
-        cout << "Total Riders: " << riders.size() << endl;
-        cout << "Total Drivers: " << drivers.size() << endl;
-        cout << "Active Rides: " << activeRides.size() << endl;
-        cout << "Completed Rides: " << completedRides.size() << endl;
-        
-        double totalEarnings = 0;
-        int totalTrips = 0;
-        int availableDrivers = 0;
-        for (Driver* driver : drivers) {
-            totalEarnings += driver->getEarnings();
-            totalTrips += driver->getTotalTrips();
-            if (driver->getStatus() == Driver::AVAILABLE) {
-                availableDrivers++;
-            }
+        int number = atoi(value.c_str());
+        if (number <= 0) {
+            cout << " Invalid value for " << arg << ": " << value << endl;
+            return false;
         }
-        
-        cout << "Total Driver Earnings: ₹" << fixed << setprecision(2) << totalEarnings << endl;
-        cout << " Total Trips Completed: " << totalTrips << endl;
-        cout << " Available Drivers Now: " << availableDrivers << endl;
-        
-        if (!completedRides.empty()) {
-            double avgFare = 0;
-            for (Ride* ride : completedRides) {
-                avgFare += ride->getFare();
-            }
-            avgFare /= completedRides.size();
-            cout << " Average Fare: ₹" << fixed << setprecision(2) << avgFare << endl;
+        if (arg == "--ticks") options.ticks = number;
+        else if (arg == "--ticks-per-hour") options.ticksPerHour = number;
+        else if (arg == "--jobs") options.jobs = number;
+        else {
+            cout << " Unknown option: " << arg << endl;
+            return false;
         }
     }
-    
-  
-    void setDriversOnlineManually() {
-        cout << "\n SETTING DRIVERS ONLINE MANUALLY...\n";
-        int count = 0;
-        for (Driver* driver : drivers) {
-            if (driver->getStatus() == Driver::OFFLINE) {
-                driver->goOnline();
-                count++;
-            }
-        }
-        cout  << count << " drivers are now online\n";
+    if (options.seeds.empty()) {
+        for (uint64_t seed = 1; seed <= 10; seed++) options.seeds.push_back(seed);
     }
-    
-    void run() {
-        cout << "================================================================================\n";
-        cout << "                   UBER/RAPIDO RIDE-SHARING SIMULATOR (DATA MODE)              \n";
-        cout << "================================================================================\n";
-        
-        bool running = true;
-        while (running) {
-            cout << "\n\n MAIN MENU:\n";
-            cout << "==========================================\n";
-            cout << "1. Show Available Drivers & Locations\n";
-            cout << "2. Show All Drivers Status\n";
-            cout << "3. Show Riders\n";
-            cout << "4. Request Random Ride\n";
-            cout << "5. Show Active Rides\n";
-            cout << "6. Show Statistics\n";
-            cout << "7. Set Scenario (Rush Hour/Moderate/Late Night/Weekend)\n";
-            cout << "8. Set All Drivers Online (NEW)\n";
-            cout << "9. Update Simulation (Advance Time)\n";
-            cout << "10. Add Random Ride Requests\n";
-            cout << "0. Exit\n";
-            cout << "==========================================\n";
-            cout << "Choose option: ";
-            
-            int choice;
-            cin >> choice;
-            
-            switch(choice) {
-                case 1:
-                    showAvailableDrivers();
-                    break;
-                case 2:
-                    showAllDrivers();
-                    break;
-                case 3:
-                    showRiders();
-                    break;
-                case 4:
-                    if (!riders.empty()) {
-                        requestRide(rand() % riders.size());
-                    }
-                    break;
-                case 5:
-                    showActiveRides();
-                    break;
-                case 6:
-                    showStatistics();
-                    break;
-                case 7:
-                    {
-                        cout << "Choose scenario:\n";
-                        cout << "1. Rush Hour (80% drivers online)\n";
-                        cout << "2. Moderate (60% drivers online)\n"; 
-                        cout << "3. Late Night (30% drivers online)\n";
-                        cout << "4. Weekend (70% drivers online)\n";
-                        int sc;
-                        cin >> sc;
-                        string scenarios[] = {"rush-hour", "moderate", "late-night", "weekend"};
-                        if (sc >= 1 && sc <= 4) {
-                            setScenario(scenarios[sc-1]);
-                        } else {
-                            cout << " Invalid scenario choice!\n";
-                        }
-                    }
-                    break;
-                case 8:
-                    setDriversOnlineManually();
-                    break;
-                case 9:
-                    updateSimulation();
-                    cout << " Simulation updated!\n";
-                    break;
-                case 10:
-                    {
-                        int numRequests = rand() % 3 + 1; 
-                        cout << " Generating " << numRequests << " random ride requests...\n";
-                        for (int i = 0; i < numRequests; i++) {
-                            if (!riders.empty()) {
-                                requestRide(rand() % riders.size());
-                            }
-                        }
-                    }
-                    break;
-                case 0:
-                    running = false;
-                    break;
-                default:
-                    cout << " Invalid choice!\n";
-            }
-            
-            
-            sleep(1);
+    if (options.scenarios.empty() || options.drivers.empty() || options.riders.empty()) {
+        cout << " Empty sweep grid" << endl;
+        return false;
+    }
+    return true;
+}
+
+int runSweepMode(int argc, char* argv[]) {
+    SweepOptions options;
+    if (!parseSweepOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    MonteCarloSweep sweep(options.ticks, options.ticksPerHour);
+    sweep.addGrid(options.scenarios, options.drivers, options.riders, options.seeds);
+    cout << "Sweep: " << sweep.size() << " runs (" << options.scenarios.size() << " scenario(s) x " 
+         << options.drivers.size() << " fleet size(s) x " << options.riders.size() << " rider count(s) x " 
+         << options.seeds.size() << " seed(s)), " << options.ticks << " ticks each, " << options.jobs << " job(s)\n";
+    
+    auto start = chrono::steady_clock::now();
+    sweep.run(options.jobs);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    double busy = 0;
+    for (const MonteCarloSweep::Result& result : sweep.getResults()) busy += result.millis / 1000;
+    cout << "\n SWEEP SUMMARY:\n";
+    cout << "==========================================\n";
+    cout << "Wall time: " << fixed << setprecision(3) << seconds << " s | " << setprecision(1) 
+         << sweep.size() / max(seconds, 1e-9) << " runs/s | Run time / wall time: " << setprecision(2) 
+         << busy / max(seconds, 1e-9) << endl;
+    sweep.printSummary();
+    
+    if (!options.outputPath.empty()) {
+        if (!sweep.writeCsv(options.outputPath)) {
+            cout << " Cannot write results file: " << options.outputPath << endl;
+            return 1;
         }
-        
-        cout << "\n================================================================================\n";
-        cout << "                         SIMULATION ENDED - FINAL STATISTICS                    \n";
-        cout << "================================================================================\n";
-        showStatistics();
+        cout << "Per-run results written to " << options.outputPath << endl;
     }
-};
+    return 0;
+}
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        string mode = argv[1];
+        if (mode == "--batch") {
+            return runBatchMode(argc, argv);
+        }
+        if (mode == "--sweep") {
+            return runSweepMode(argc, argv);
+        }
+        printUsage(argv[0]);
+        return mode == "--help" ? 0 : 1;
+    }
+    
     RideSharingSimulator simulator;
     simulator.run();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,323 @@
+#include "simulator.h"
+
+using namespace std;
+
+// Benchmarks for the simulator core. Every measurement is one line of output,
+// either a JSON object or a CSV row, so runs can be diffed and plotted to catch
+// regressions. Fleet-size dependent benchmarks repeat for every --sizes entry.
+
+struct BenchOptions {
+    vector<int> sizes = {10, 100, 1000, 10000, 100000, 1000000};
+    int ticks = 200;
+    int samples = 2000;
+    int threads = 1;
+    uint64_t seed = 42;
+    bool csv = false;
+    string outputPath;
+};
+
+struct BenchResult {
+    string name;
+    int drivers;
+    string metric;
+    double value;
+    string unit;
+};
+
+class BenchReport {
+private:
+    ostream& out;
+    bool csv;
+
+public:
+    BenchReport(ostream& out, bool csv) : out(out), csv(csv) {
+        if (csv) out << "benchmark,drivers,metric,value,unit\n";
+    }
+
+    void add(const BenchResult& result) {
+        if (csv) {
+            out << result.name << "," << result.drivers << "," << result.metric << ","
+                << fixed << setprecision(3) << result.value << "," << result.unit << "\n";
+        } else {
+            out << "{\"benchmark\":\"" << result.name << "\",\"drivers\":" << result.drivers
+                << ",\"metric\":\"" << result.metric << "\",\"value\":" << fixed << setprecision(3) << result.value
+                << ",\"unit\":\"" << result.unit << "\"}\n";
+        }
+        out.flush();
+    }
+
+    void addLatency(const string& name, int drivers, const QuantileSketch& nanos) {
+        add({name, drivers, "mean", nanos.getMean(), "ns"});
+        add({name, drivers, "p50", nanos.quantile(0.50), "ns"});
+        add({name, drivers, "p99", nanos.quantile(0.99), "ns"});
+        add({name, drivers, "max", nanos.getMax(), "ns"});
+    }
+};
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Scattered points over the map; the sum keeps the loop from being optimised away.
+void benchDistance(BenchReport& report, const BenchOptions& options) {
+    const size_t points = 1 << 20;
+    const int rounds = 50;
+    RandomStream rng(options.seed, 0);
+    vector<Location> locations;
+    locations.reserve(points);
+    for (size_t i = 0; i < points; i++) {
+        locations.push_back(Location(rng.nextDouble() * 20.0, rng.nextDouble() * 20.0));
+    }
+
+    Location center(10, 10);
+    volatile double sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        double sum = 0;
+        for (const Location& at : locations) sum += at.distanceTo(center);
+        sink = sink + sum;
+    }
+    double seconds = secondsSince(start);
+    report.add({"distance_to", 0, "throughput", points * rounds / seconds / 1e6, "Mcalls/s"});
+}
+
+// Each sample opens a ride for an idle rider and times only the match. Matched
+// drivers leave the pool, so once half the fleet is busy the rides are played
+// out before sampling continues.
+void benchAssign(BenchReport& report, const BenchOptions& options, int drivers) {
+    int riders = max(1, min(options.samples, drivers / 2));
+    RideSharingSimulator simulator(riders, drivers, EventJournal::QUIET, options.seed);
+    simulator.setThreadCount(options.threads);
+    RandomStream rng(options.seed, 1);
+    QuantileSketch nanos;
+
+    int taken = 0;
+    while (taken < options.samples) {
+        for (int i = 0; i < riders && taken < options.samples; i++) {
+            Rider& rider = simulator.getRider(i);
+            if (rider.hasRide()) continue;
+            Location destination(rng.nextInt(18) + 1, rng.nextInt(18) + 1);
+            RideHandle handle = simulator.openRide(rider, rider.getLocation(), destination);
+            auto start = chrono::steady_clock::now();
+            simulator.assignDriverToRide(handle);
+            nanos.add(max(1.0, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()));
+            taken++;
+        }
+        while (simulator.getActiveRideCount() > 0) simulator.updateSimulation();
+    }
+    report.addLatency("assign_driver", drivers, nanos);
+}
+
+// Loads the fleet with rides (one request per 20 riders per tick, as in batch
+// mode), then times updateSimulation alone and the full request-to-settlement loop.
+void benchTicks(BenchReport& report, const BenchOptions& options, int drivers) {
+    int riders = max(1, drivers / 2);
+    int requestsPerTick = max(1, riders / 20);
+    RideSharingSimulator simulator(riders, drivers, EventJournal::QUIET, options.seed);
+    simulator.setThreadCount(options.threads);
+    simulator.runTicks(options.ticks / 4 + 1, requestsPerTick);
+
+    auto start = chrono::steady_clock::now();
+    for (int tick = 0; tick < options.ticks; tick++) simulator.updateSimulation();
+    double seconds = secondsSince(start);
+    report.add({"update_simulation", drivers, "throughput", options.ticks / seconds, "ticks/s"});
+
+    long completedBefore = simulator.getStats().getCompletedRides();
+    start = chrono::steady_clock::now();
+    simulator.runTicks(options.ticks, requestsPerTick);
+    seconds = secondsSince(start);
+    long completed = simulator.getStats().getCompletedRides() - completedBefore;
+    report.add({"end_to_end", drivers, "rides", completed / seconds, "rides/s"});
+    report.add({"end_to_end", drivers, "ticks", options.ticks / seconds, "ticks/s"});
+}
+
+// Queues a batch of requests behind a dispatch window that never comes due,
+// then times the single dispatchPending() that matches them: the candidate
+// queries plus the auction. Each round is played out before the next queues.
+void benchDispatch(BenchReport& report, const BenchOptions& options, int drivers) {
+    const int batch = 10000;
+    const int rounds = 10;
+    RideSharingSimulator simulator(batch, drivers, EventJournal::QUIET, options.seed);
+    simulator.setThreadCount(options.threads);
+    RandomStream rng(options.seed, 2);
+    QuantileSketch nanos;
+
+    for (int round = 0; round < rounds; round++) {
+        simulator.setDispatchWindow(1 << 30, 8);
+        for (int i = 0; i < batch; i++) {
+            Rider& rider = simulator.getRider(i);
+            if (rider.hasRide()) continue;
+            simulator.submitRide(rider, rider.getLocation(), Location(rng.nextInt(18) + 1, rng.nextInt(18) + 1));
+        }
+        auto start = chrono::steady_clock::now();
+        simulator.dispatchPending();
+        nanos.add(max(1.0, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()));
+        simulator.setDispatchWindow(0, 8);
+        while (simulator.getActiveRideCount() > 0) simulator.updateSimulation();
+    }
+    report.addLatency("dispatch_pending", drivers, nanos);
+}
+
+// Times the zone pass alone (surge plus repositioning picks) on a fleet that
+// is already carrying rides, with a zone for each unit square of the map.
+void benchZones(BenchReport& report, const BenchOptions& options, int drivers) {
+    int riders = max(1, drivers / 2);
+    int requestsPerTick = max(1, riders / 20);
+    RideSharingSimulator simulator(riders, drivers, EventJournal::QUIET, options.seed);
+    simulator.setThreadCount(options.threads);
+    simulator.setZones(1.0, true);
+    simulator.runTicks(options.ticks / 4 + 1, requestsPerTick);
+
+    QuantileSketch nanos;
+    for (int tick = 0; tick < options.ticks; tick++) {
+        simulator.runTicks(1, requestsPerTick);
+        auto start = chrono::steady_clock::now();
+        simulator.refreshZones();
+        nanos.add(max(1.0, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()));
+    }
+    report.addLatency("zone_refresh", drivers, nanos);
+}
+
+// Not a timing: runs the same road-network batch on both engines and reports
+// whether they agree. The 8x8 grid's 20/7 spacing is not a multiple of the
+// driver speed, so steps have to land on junctions rather than pass them.
+bool checkEngineAgreement(BenchReport& report, const BenchOptions& options) {
+    const int junctions = 8;
+    const double spacing = 20.0 / 7;
+    const char* directory = getenv("TMPDIR");
+    string path = string(directory && *directory ? directory : "/tmp") + "/ride_bench_grid_XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        cout << " Cannot create road network file: " << path << endl;
+        return false;
+    }
+    close(fd);
+    {
+        ofstream grid(path);
+        for (int j = 0; j < junctions; j++) {
+            for (int i = 0; i < junctions; i++) grid << "n " << i * spacing << " " << j * spacing << "\n";
+        }
+        for (int v = 0; v < junctions * junctions; v++) {
+            if (v % junctions + 1 < junctions) grid << "e " << v << " " << v + 1 << "\n";
+            if (v + junctions < junctions * junctions) grid << "e " << v << " " << v + junctions << "\n";
+        }
+    }
+
+    long completed[2];
+    double fares[2];
+    bool loaded = true;
+    for (int engine = 0; engine < 2 && loaded; engine++) {
+        RideSharingSimulator simulator(100, 200, EventJournal::QUIET, options.seed);
+        simulator.setEngine(engine ? RideSharingSimulator::EVENT_ENGINE : RideSharingSimulator::TICK_ENGINE);
+        loaded = simulator.loadRoads(path, "");
+        if (!loaded) break;
+        simulator.runTicks(300, 5);
+        completed[engine] = simulator.getStats().getCompletedRides();
+        fares[engine] = simulator.getStats().getTotalFares();
+    }
+    remove(path.c_str());
+    if (!loaded) {
+        cout << " Cannot load road network: " << path << endl;
+        return false;
+    }
+
+    bool agree = completed[0] == completed[1] && fabs(fares[0] - fares[1]) < 1e-6;
+    report.add({"engine_agreement", 200, "tick_rides", (double)completed[0], "rides"});
+    report.add({"engine_agreement", 200, "event_rides", (double)completed[1], "rides"});
+    report.add({"engine_agreement", 200, "agree", agree ? 1.0 : 0.0, "bool"});
+    if (!agree) cout << " Tick and event engines disagree on the road grid" << endl;
+    return agree;
+}
+
+void printBenchUsage(const char* program) {
+    cout << "Usage: " << program << " [options]\n"
+         << "  --sizes A,B,...   fleet sizes (default 10,100,1000,10000,100000,1000000)\n"
+         << "  --ticks K         timed ticks per fleet size (default 200)\n"
+         << "  --samples N       assignDriverToRide samples per fleet size (default 2000)\n"
+         << "  --threads T       worker threads for the tick engine (default 1)\n"
+         << "  --seed S          random seed (default 42)\n"
+         << "  --format NAME     json (default, one object per line) | csv\n"
+         << "  --output FILE     write results to FILE instead of stdout\n";
+}
+
+bool parseBenchOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cout << " Missing value for " << arg << endl;
+            return false;
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                int size = atoi(item.c_str());
+                if (size <= 0) {
+                    cout << " Invalid fleet size: " << item << endl;
+                    return false;
+                }
+                options.sizes.push_back(size);
+            }
+            continue;
+        }
+        if (arg == "--format") {
+            if (value != "json" && value != "csv") {
+                cout << " Unknown format: " << value << endl;
+                return false;
+            }
+            options.csv = value == "csv";
+            continue;
+        }
+        if (arg == "--output") {
+            options.outputPath = value;
+            continue;
+        }
+        if (arg == "--seed") {
+            options.seed = strtoull(value.c_str(), nullptr, 10);
+            continue;
+        }
+        int number = atoi(value.c_str());
+        if (number <= 0) {
+            cout << " Invalid value for " << arg << ": " << value << endl;
+            return false;
+        }
+        if (arg == "--ticks") options.ticks = number;
+        else if (arg == "--samples") options.samples = number;
+        else if (arg == "--threads") options.threads = number;
+        else {
+            cout << " Unknown option: " << arg << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseBenchOptions(argc, argv, options)) {
+        printBenchUsage(argv[0]);
+        return 1;
+    }
+
+    ofstream file;
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath);
+        if (!file) {
+            cout << " Cannot open output file: " << options.outputPath << endl;
+            return 1;
+        }
+    }
+    BenchReport report(options.outputPath.empty() ? cout : file, options.csv);
+
+    if (!checkEngineAgreement(report, options)) return 1;
+    benchDistance(report, options);
+    for (int drivers : options.sizes) {
+        benchAssign(report, options, drivers);
+        benchTicks(report, options, drivers);
+        benchDispatch(report, options, drivers);
+        benchZones(report, options, drivers);
+    }
+    return 0;
+}
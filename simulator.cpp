@@ -0,0 +1,2301 @@
+#include "simulator.h"
+
+using namespace std;
+
+SpatialIndex::SpatialIndex(double width, double height, double cellSize, int layer)
+    : width(width), height(height), cellSize(cellSize),
+      cols(max(1, (int)ceil(width / cellSize))), rows(max(1, (int)ceil(height / cellSize))),
+      cells(cols * rows), count(0), layer(layer) {}
+
+int SpatialIndex::cellOf(const Location& loc) const {
+    int cx = min(max((int)floor(loc.getX() / cellSize), 0), cols - 1);
+    int cy = min(max((int)floor(loc.getY() / cellSize), 0), rows - 1);
+    return cy * cols + cx;
+}
+
+void SpatialIndex::insert(Driver* driver) {
+    if (driver->gridCell[layer] >= 0) return;
+    int cell = cellOf(driver->getLocation());
+    driver->gridCell[layer] = cell;
+    driver->gridSlot[layer] = cells[cell].size();
+    cells[cell].push_back(driver);
+    count++;
+}
+
+void SpatialIndex::remove(Driver* driver) {
+    if (driver->gridCell[layer] < 0) return;
+    vector<Driver*>& bucket = cells[driver->gridCell[layer]];
+    Driver* last = bucket.back();
+    bucket[driver->gridSlot[layer]] = last;
+    last->gridSlot[layer] = driver->gridSlot[layer];
+    bucket.pop_back();
+    driver->gridCell[layer] = -1;
+    driver->gridSlot[layer] = -1;
+    count--;
+}
+
+void SpatialIndex::update(Driver* driver) {
+    if (driver->gridCell[layer] < 0 || cellOf(driver->getLocation()) == driver->gridCell[layer]) return;
+    remove(driver);
+    insert(driver);
+}
+
+vector<Driver*> SpatialIndex::queryRadius(const Location& center, double radius) const {
+    vector<Driver*> result;
+    int minX = max((int)floor((center.getX() - radius) / cellSize), 0);
+    int maxX = min((int)floor((center.getX() + radius) / cellSize), cols - 1);
+    int minY = max((int)floor((center.getY() - radius) / cellSize), 0);
+    int maxY = min((int)floor((center.getY() + radius) / cellSize), rows - 1);
+    double radiusSquared = radius * radius;
+    
+    for (int cy = minY; cy <= maxY; cy++) {
+        for (int cx = minX; cx <= maxX; cx++) {
+            for (Driver* driver : cells[cy * cols + cx]) {
+                if (driver->getLocation().squaredDistanceTo(center) <= radiusSquared) {
+                    result.push_back(driver);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+void SpatialIndex::collectRing(const Location& center, int cx, int cy, int ring, size_t k, double maxSquared,
+                               vector<pair<double, Driver*>>& best) const {
+    auto consider = [&](int x, int y) {
+        if (x < 0 || x >= cols || y < 0 || y >= rows) return;
+        for (Driver* driver : cells[y * cols + x]) {
+            double d = driver->getLocation().squaredDistanceTo(center);
+            if (d >= maxSquared) continue;
+            pair<double, Driver*> entry(d, driver);
+            // Ties go to the lower driver id, matching a front-to-back scan of the fleet.
+            auto closer = [](const pair<double, Driver*>& a, const pair<double, Driver*>& b) {
+                return a.first < b.first || (a.first == b.first && a.second->id < b.second->id);
+            };
+            if (best.size() == k && !closer(entry, best.back())) continue;
+            best.insert(upper_bound(best.begin(), best.end(), entry, closer), entry);
+            if (best.size() > k) best.pop_back();
+        }
+    };
+    
+    if (ring == 0) {
+        consider(cx, cy);
+        return;
+    }
+    for (int x = cx - ring; x <= cx + ring; x++) {
+        consider(x, cy - ring);
+        consider(x, cy + ring);
+    }
+    for (int y = cy - ring + 1; y <= cy + ring - 1; y++) {
+        consider(cx - ring, y);
+        consider(cx + ring, y);
+    }
+}
+
+vector<Driver*> SpatialIndex::kNearest(const Location& center, size_t k, double maxDistance) const {
+    vector<pair<double, Driver*>> best;
+    vector<Driver*> result;
+    if (k == 0 || count == 0) return result;
+    
+    int cell = cellOf(center);
+    int cx = cell % cols;
+    int cy = cell / cols;
+    double maxSquared = maxDistance * maxDistance;
+    int maxRing = max(max(cx, cols - 1 - cx), max(cy, rows - 1 - cy));
+    
+    for (int ring = 0; ring <= maxRing; ring++) {
+        // Everything not yet visited lies outside the square of rings 0..ring-1.
+        double left = center.getX() - (cx - ring + 1) * cellSize;
+        double right = (cx + ring) * cellSize - center.getX();
+        double bottom = center.getY() - (cy - ring + 1) * cellSize;
+        double top = (cy + ring) * cellSize - center.getY();
+        double bound = ring == 0 ? 0.0 : max(0.0, min(min(left, right), min(bottom, top)));
+        double boundSquared = bound * bound;
+        
+        if (boundSquared >= maxSquared) break;
+        if (best.size() == k && boundSquared > best.back().first) break;
+        collectRing(center, cx, cy, ring, k, maxSquared, best);
+    }
+    
+    for (auto& entry : best) result.push_back(entry.second);
+    return result;
+}
+
+Driver* SpatialIndex::nearest(const Location& center, double maxDistance) const {
+    vector<Driver*> found = kNearest(center, 1, maxDistance);
+    return found.empty() ? nullptr : found[0];
+}
+
+RideSharingSimulator::RideSharingSimulator(int numRiders, int numDrivers,
+                                           EventJournal::Verbosity verbosity,
+                                           uint64_t seed)
+    : journal(verbosity), metricsJson(false), metricsInterval(1000), exportFormat(CSV_EXPORT), exportEvery(0),
+      exportFailures(0), driverIndex(MAP_SIZE, MAP_SIZE, GRID_CELL_SIZE),
+      vehiclePools(VEHICLE_CLASS_COUNT, SpatialIndex(MAP_SIZE, MAP_SIZE, GRID_CELL_SIZE, 1)),
+      tickPool(new WorkStealingPool(1)), engine(TICK_ENGINE), scheduleSequence(0),
+      dispatchWindow(0), dispatchCandidates(8), nextRiderId(1), nextDriverId(1), nextRideId(1), currentTick(0),
+      traceRiderCursor(0), seed(seed), demandStream(seed, DEMAND_STREAM), scenarioStream(seed, SCENARIO_STREAM),
+      surge(1.0),
+      repositioning(false), repositionMoves(0),
+      regionMinX(-HUGE_VAL), regionMaxX(HUGE_VAL), sharded(false), rideIdStride(1) {
+    initializeScenarios();
+    initializeSampleData(numRiders, numDrivers);
+    setInitialDriversOnline(); 
+}
+
+RideSharingSimulator::~RideSharingSimulator() {
+    for (auto rider : riders) delete rider;
+    for (auto driver : drivers) delete driver;
+}
+
+void RideSharingSimulator::setDispatchWindow(int ticks, int candidates) {
+    dispatchPending();
+    dispatchWindow = max(0, ticks);
+    dispatchCandidates = max(1, candidates);
+}
+
+bool RideSharingSimulator::loadRoads(const string& path, const string& cachePath) {
+    unique_ptr<RoadNetwork> network(new RoadNetwork());
+    if (!network->load(path) || !network->prepare(cachePath)) return false;
+    roads.swap(network);
+    distanceCache.configure(nullptr, 0, 0);
+    for (Driver* driver : drivers) driver->attachRoads(roads.get());
+    return true;
+}
+
+bool RideSharingSimulator::setDistanceCache(size_t capacity, double quantum, size_t hotZones) {
+    if (!roads) return false;
+    distanceCache.configure(roads.get(), capacity, quantum);
+    vector<Location> homes;
+    homes.reserve(riders.size());
+    for (Rider* rider : riders) homes.push_back(rider->getLocation());
+    distanceCache.precompute(homes, hotZones);
+    return true;
+}
+
+void RideSharingSimulator::setMetricsExport(const string& path, bool json, int intervalMillis) {
+    metricsPath = path;
+    metricsJson = json;
+    metricsInterval = chrono::milliseconds(max(1, intervalMillis));
+    lastMetricsExport = chrono::steady_clock::now();
+}
+
+bool RideSharingSimulator::setEngine(Engine newEngine) {
+    if (newEngine != engine && !activeRides.empty()) return false;
+    engine = newEngine;
+    return true;
+}
+
+void RideSharingSimulator::initializeScenarios() {
+    scenarios.push_back(ScenarioProfile{"rush-hour", 0.8, 0.7, 1.5});
+    scenarios.push_back(ScenarioProfile{"moderate", 0.6, 0.4, 1.0});
+    scenarios.push_back(ScenarioProfile{"late-night", 0.3, 0.2, 2.0});
+    scenarios.push_back(ScenarioProfile{"weekend", 0.7, 0.6, 1.3});
+}
+
+void RideSharingSimulator::initializeSampleData(int numRiders, int numDrivers) {
+    journal.narrate() << " INITIALIZING RIDE-SHARING SIMULATOR...\n";
+    
+    riders.reserve(numRiders);
+    drivers.reserve(numDrivers);
+    driverStore.reserve(numDrivers);
+    
+    for (int i = 0; i < numRiders; i++) {
+        addRider(sampleRider(seed, i));
+    }
+    for (int i = 0; i < numDrivers; i++) {
+        addDriver(sampleDriver(seed, i));
+    }
+    
+    journal.narrate() << "Created " << riders.size() << " riders and " << drivers.size() << " drivers";
+}
+
+void RideSharingSimulator::setInitialDriversOnline() {
+    journal.narrate() << "\n SETTING INITIAL DRIVERS ONLINE...";
+    int onlineCount = 0;
+   
+    for (Driver* driver : drivers) {
+        if (startsOnline(seed, driver->getId() - 1)) { 
+            driver->goOnline();
+            onlineCount++;
+        }
+    }
+    journal.narrate() << onlineCount << " drivers are now online and available";
+}
+
+RideSharingSimulator::RiderTransfer RideSharingSimulator::sampleRider(uint64_t seed, int i) {
+    static const char* names[] = {"Aarav Sharma", "Priya Patel", "Rohan Singh", "Neha Gupta", "Vikram Joshi"};
+    static const Location homes[] = {Location(5, 5), Location(15, 8), Location(8, 15), Location(12, 3), Location(3, 12)};
+    if (i < 5) return RiderTransfer{names[i], homes[i], 1000.0, false};
+    RandomStream riderStream(seed, RIDER_STREAM, i + 1);
+    return RiderTransfer{"Rider " + to_string(i + 1), randomLocation(riderStream), 1000.0, false};
+}
+
+RideSharingSimulator::DriverTransfer RideSharingSimulator::sampleDriver(uint64_t seed, int i) {
+    static const char* plates[] = {"DL01AB", "MH02CD", "KA03EF", "TN04GH", "UP05IJ"};
+    RandomStream driverStream(seed, DRIVER_STREAM, i + 1);
+    DriverTransfer driver;
+    driver.name = "Driver " + to_string(i + 1);
+    driver.location = randomLocation(driverStream);
+    driver.vehicle = (VehicleClass)(SEDAN + driverStream.nextInt(4));
+    driver.licensePlate = plates[driverStream.nextInt(5)];
+    driver.licensePlate += to_string(driverStream.nextInt(1000));
+    driver.speed = Driver::DEFAULT_SPEED;
+    driver.earnings = 0.0;
+    driver.rating = 5.0;
+    driver.totalTrips = 0;
+    driver.status = Driver::OFFLINE;
+    return driver;
+}
+
+bool RideSharingSimulator::startsOnline(uint64_t seed, int i) {
+    RandomStream onlineStream(seed, ONLINE_STREAM, i + 1);
+    return onlineStream.nextInt(100) < 60;
+}
+
+int RideSharingSimulator::addDriver(const DriverTransfer& transfer) {
+    Driver* driver;
+    if (freeDriverIds.empty()) {
+        driver = new Driver(driverStore, strings, nextDriverId++, transfer.name, transfer.location,
+                            transfer.vehicle, transfer.licensePlate, &journal);
+        drivers.push_back(driver);
+        driver->attachIndex(&driverIndex, &vehiclePools[transfer.vehicle]);
+        driver->attachRoads(roads.get());
+    } else {
+        driver = drivers[freeDriverIds.back() - 1];
+        freeDriverIds.pop_back();
+        driver->nameId = strings.intern(transfer.name);
+        driver->plateId = strings.intern(transfer.licensePlate);
+        driverStore.setLocation(driver->slot, transfer.location);
+        driver->setStatus(Driver::OFFLINE);
+        driver->vehicle = transfer.vehicle;
+        driver->attachIndex(&driverIndex, &vehiclePools[transfer.vehicle]);
+    }
+    driverStore.speed[driver->slot] = transfer.speed;
+    driver->earnings = transfer.earnings;
+    driver->rating = transfer.rating;
+    driver->totalTrips = transfer.totalTrips;
+    if (transfer.status != Driver::OFFLINE) driver->setStatus(transfer.status);
+    return driver->id;
+}
+
+RideSharingSimulator::DriverTransfer RideSharingSimulator::releaseDriver(Driver& driver) {
+    DriverTransfer transfer{driver.getName(), driver.vehicle, driver.getLicensePlate(), driver.getLocation(),
+                            driverStore.speed[driver.slot], driver.earnings, driver.rating, 
+                            driver.totalTrips, driver.getStatus()};
+    driver.setStatus(Driver::DEPARTED);
+    freeDriverIds.push_back(driver.id);
+    return transfer;
+}
+
+int RideSharingSimulator::addRider(const RiderTransfer& transfer) {
+    Rider* rider;
+    if (freeRiderIds.empty()) {
+        rider = new Rider(nextRiderId++, transfer.name, transfer.location, &journal);
+        riders.push_back(rider);
+    } else {
+        rider = riders[freeRiderIds.back() - 1];
+        freeRiderIds.pop_back();
+        rider->name = transfer.name;
+        rider->location = transfer.location;
+    }
+    rider->balance = transfer.balance;
+    rider->hasActiveRide = transfer.hasRide;
+    rider->departed = false;
+    return rider->id;
+}
+
+RideSharingSimulator::RiderTransfer RideSharingSimulator::releaseRider(Rider& rider) {
+    RiderTransfer transfer{rider.name, rider.location, rider.balance, rider.hasActiveRide};
+    rider.hasActiveRide = true;
+    rider.departed = true;
+    freeRiderIds.push_back(rider.id);
+    return transfer;
+}
+
+RideSharingSimulator::RideTransfer RideSharingSimulator::releaseRide(const Ride& ride) {
+    RideTransfer transfer{ride, releaseRider(riderById(ride.getRiderId())), DriverTransfer()};
+    if (ride.hasDriver()) transfer.driver = releaseDriver(driverById(ride.getDriverId()));
+    return transfer;
+}
+
+RideHandle RideSharingSimulator::adoptRide(const RideTransfer& transfer) {
+    Ride ride = transfer.ride;
+    ride.riderId = addRider(transfer.rider);
+    ride.driverId = ride.hasDriver() ? addDriver(transfer.driver) : 0;
+    ride.journal = &journal;
+    return activeRides.insert(ride);
+}
+
+void RideSharingSimulator::setShard(double minX, double maxX, int firstRideId, int idStride) {
+    regionMinX = minX;
+    regionMaxX = maxX;
+    nextRideId = firstRideId;
+    rideIdStride = idStride;
+    sharded = true;
+}
+
+double RideSharingSimulator::edgeDistance(const Location& at) const {
+    return min(at.getX() - regionMinX, regionMaxX - at.getX());
+}
+
+void RideSharingSimulator::matchInShard(RideHandle handle, Rider& rider) {
+    ScopedPhase timer(metrics, PhaseMetrics::MATCHING);
+    const Ride& ride = *activeRides.get(handle);
+    Location pickup = ride.getPickup();
+    Driver* nearestDriver = poolFor(ride.getVehicleClass()).nearest(pickup, MAX_PICKUP_DISTANCE);
+    if (nearestDriver && nearestDriver->getLocation().distanceTo(pickup) <= edgeDistance(pickup)) {
+        commitAssignment(handle, *nearestDriver);
+        return;
+    }
+    rider.setRideStatus(true);
+    deferredRides.push_back(handle);
+}
+
+void RideSharingSimulator::handOff() {
+    for (size_t i = 0; i < activeRides.size();) {
+        const Ride& ride = activeRides[i];
+        if (ride.getStatus() == Ride::IN_PROGRESS && !owns(ride.getDestination())) {
+            outgoingRides.push_back(releaseRide(ride));
+            activeRides.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+    for (int id : movedDrivers) {
+        Driver& driver = driverById(id);
+        if (driver.getStatus() == Driver::AVAILABLE && !owns(driver.getLocation())) {
+            outgoingDrivers.push_back(releaseDriver(driver));
+        }
+    }
+    movedDrivers.clear();
+}
+
+long RideSharingSimulator::movesUntilArrival(Location& at, const Location& target, double speed, const RoadNetwork* roads) {
+    vector<Location> route = roads ? roads->route(at, target) : vector<Location>(1, target);
+    size_t step = 0;
+    double x = at.getX(), y = at.getY();
+    long moves = 0;
+    while (Location(x, y).distanceTo(target) >= Ride::ARRIVAL_RADIUS && speed > 0) {
+        step = Driver::nextWaypoint(route, step, Location(x, y));
+        DriverStore::step(x, y, route[step].getX(), route[step].getY(), speed);
+        moves++;
+    }
+    at = Location(x, y);
+    return moves;
+}
+
+void RideSharingSimulator::scheduleTransition(RideHandle handle, long tick, Ride::RideStatus next, Location driverAt) {
+    schedule.push(ScheduledTransition{tick, scheduleSequence++, handle, next, driverAt});
+}
+
+void RideSharingSimulator::scheduleLeg(RideHandle handle, const Location& from, const Location& to, Ride::RideStatus next) {
+    const Ride& ride = *activeRides.get(handle);
+    Location at = from;
+    long moves = movesUntilArrival(at, to, driverStore.speed[driverById(ride.getDriverId()).getSlot()], roads.get());
+    scheduleTransition(handle, currentTick + 1 + moves, next, at);
+}
+
+void RideSharingSimulator::processDueTransitions() {
+    while (!schedule.empty() && schedule.top().tick <= currentTick) {
+        ScheduledTransition due = schedule.top();
+        schedule.pop();
+        Ride* ride = activeRides.get(due.ride);
+        if (!ride) continue;
+        
+        Driver& driver = driverById(ride->getDriverId());
+        Rider& rider = riderById(ride->getRiderId());
+        ScopedPhase timer(metrics, due.next == Ride::COMPLETED ? PhaseMetrics::SETTLEMENT : PhaseMetrics::RIDE_UPDATE);
+        switch(due.next) {
+            case Ride::PICKUP_REACHED:
+                driver.setLocation(due.driverAt);
+                ride->reachPickup(driver, rider, currentTick);
+                scheduleTransition(due.ride, currentTick + 1, Ride::IN_PROGRESS, due.driverAt);
+                break;
+                
+            case Ride::IN_PROGRESS:
+                ride->beginTrip(rider);
+                scheduleLeg(due.ride, due.driverAt, ride->getDestination(), Ride::COMPLETED);
+                break;
+                
+            case Ride::COMPLETED:
+                driver.setLocation(due.driverAt);
+                ride->markArrived();
+                ride->completeRide(driver, rider, currentTick);
+                recordCompletion(*ride);
+                activeRides.remove(due.ride);
+                break;
+                
+            default:
+                break;
+        }
+    }
+}
+
+void RideSharingSimulator::commitAssignment(RideHandle handle, Driver& driver) {
+    Ride& ride = *activeRides.get(handle);
+    ride.assignDriver(driver, riderById(ride.getRiderId()));
+    if (engine == EVENT_ENGINE) {
+        scheduleLeg(handle, driver.getLocation(), ride.getPickup(), Ride::PICKUP_REACHED);
+    }
+    if (journal.narrating()) {
+        journal.narrate() << " Nearest driver: " << driver.getName() << " (" << fixed << setprecision(2) 
+                          << travelDistance(driver.getLocation(), ride.getPickup()) << " units away)";
+    }
+}
+
+void RideSharingSimulator::cancelUnmatched(RideHandle handle) {
+    Ride& ride = *activeRides.get(handle);
+    if (journal.narrating()) {
+        journal.narrate() << " No available drivers found! Ride cancelled.";
+        journal.narrate() << " Try setting a scenario to get more drivers online";
+    }
+    ride.cancelRide(nullptr, riderById(ride.getRiderId()));
+    stats.recordCancellation();
+    activeRides.remove(handle);
+}
+
+void RideSharingSimulator::recordCompletion(const Ride& ride) {
+    stats.recordCompletion(ride.getFare(), ride.getWaitTicks(), ride.getTripTicks());
+    completedRides.append(ride);
+}
+
+double RideSharingSimulator::travelDistance(const Location& from, const Location& to) {
+    if (distanceCache.enabled()) return distanceCache.distance(from, to);
+    return roads ? roads->distance(from, to) : from.distanceTo(to);
+}
+
+void RideSharingSimulator::pickupCosts(const Location& pickup, const vector<Driver*>& candidates, vector<double>& costs) {
+    if (!roads) {
+        costs.resize(candidates.size());
+        for (size_t i = 0; i < candidates.size(); i++) costs[i] = candidates[i]->getLocation().distanceTo(pickup);
+        return;
+    }
+    vector<Location> from(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) from[i] = candidates[i]->getLocation();
+    if (distanceCache.enabled()) {
+        distanceCache.distancesFrom(pickup, from, costs);
+    } else {
+        roads->distancesFrom(pickup, from, costs);
+    }
+}
+
+Driver& RideSharingSimulator::sampleWithStatus(Driver::Status status) {
+    const vector<int>& slots = driverStore.slotsWithStatus(status);
+    return driverAtSlot(slots[scenarioStream.nextInt(slots.size())]);
+}
+
+Location RideSharingSimulator::randomLocation(RandomStream& rng) {
+    int x = rng.nextInt(18) + 1;
+    return Location(x, rng.nextInt(18) + 1);
+}
+
+uint64_t RideSharingSimulator::snapshotChecksum(const char* data, size_t bytes, uint64_t hash) {
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 29;
+    }
+    if (i < bytes) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, bytes - i);
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+bool RideSharingSimulator::stringInPool(const SnapshotString& text, uint64_t poolBytes) {
+    return text.offset <= poolBytes && text.length <= poolBytes - text.offset;
+}
+
+bool RideSharingSimulator::restoreSnapshot(const char* data, size_t size) {
+    SnapshotHeader header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION ||
+        header.headerBytes != sizeof(header) || header.payloadBytes != size - sizeof(header)) return false;
+    
+    uint64_t payload = header.payloadBytes;
+    if (header.driverCount > payload / sizeof(DriverRecord) || header.riderCount > payload / sizeof(RiderRecord) ||
+        header.rideCount > payload / sizeof(RideRecord) || header.transitionCount > payload / sizeof(TransitionRecord) ||
+        header.pendingCount > payload / sizeof(uint32_t) || header.statsBytes > payload || 
+        header.stringBytes > payload || header.keyframeCount > payload / sizeof(KeyframeRecord) ||
+        header.zoneCount > payload / (3 * sizeof(float)) || header.indexedCount > header.driverCount) return false;
+    size_t driverOffset = sizeof(header);
+    size_t riderOffset = driverOffset + padded(header.driverCount * sizeof(DriverRecord));
+    size_t rideOffset = riderOffset + padded(header.riderCount * sizeof(RiderRecord));
+    size_t transitionOffset = rideOffset + padded(header.rideCount * sizeof(RideRecord));
+    size_t pendingOffset = transitionOffset + padded(header.transitionCount * sizeof(TransitionRecord));
+    size_t keyframeOffset = pendingOffset + padded(header.pendingCount * sizeof(uint32_t));
+    size_t zoneOffset = keyframeOffset + padded(header.keyframeCount * sizeof(KeyframeRecord));
+    size_t statusOrderOffset = zoneOffset + padded(header.zoneCount * 3 * sizeof(float));
+    size_t indexOrderOffset = statusOrderOffset + padded(header.driverCount * sizeof(uint32_t));
+    size_t poolOrderOffset = indexOrderOffset + padded(header.indexedCount * sizeof(uint32_t));
+    size_t statsOffset = poolOrderOffset + padded(header.indexedCount * sizeof(uint32_t));
+    size_t stringOffset = statsOffset + padded(header.statsBytes);
+    if (stringOffset + padded(header.stringBytes) != size) return false;
+    if (snapshotChecksum(data + sizeof(header), payload, header.seed) != header.checksum) return false;
+    
+    const DriverRecord* driverRecords = (const DriverRecord*)(data + driverOffset);
+    const RiderRecord* riderRecords = (const RiderRecord*)(data + riderOffset);
+    const RideRecord* rideRecords = (const RideRecord*)(data + rideOffset);
+    const TransitionRecord* transitionRecords = (const TransitionRecord*)(data + transitionOffset);
+    const uint32_t* pendingRecords = (const uint32_t*)(data + pendingOffset);
+    const KeyframeRecord* keyframeRecords = (const KeyframeRecord*)(data + keyframeOffset);
+    const float* zoneState = (const float*)(data + zoneOffset);
+    const uint32_t* statusOrder = (const uint32_t*)(data + statusOrderOffset);
+    const uint32_t* indexOrder = (const uint32_t*)(data + indexOrderOffset);
+    const uint32_t* poolOrder = (const uint32_t*)(data + poolOrderOffset);
+    const char* strings = data + stringOffset;
+    
+    for (uint64_t i = 0; i < header.driverCount; i++) {
+        const DriverRecord& record = driverRecords[i];
+        if (record.id != (int64_t)i + 1 || record.status > Driver::ON_TRIP || 
+            !stringInPool(record.name, header.stringBytes) || !stringInPool(record.vehicleType, header.stringBytes) ||
+            !stringInPool(record.licensePlate, header.stringBytes) ||
+            vehicleClassNamed(strings + record.vehicleType.offset, record.vehicleType.length) == ANY_VEHICLE) return false;
+    }
+    for (uint64_t i = 0; i < header.riderCount; i++) {
+        const RiderRecord& record = riderRecords[i];
+        if (record.id != (int64_t)i + 1 || !stringInPool(record.name, header.stringBytes)) return false;
+    }
+    // A ride under way needs an on-trip driver and a requested one must not
+    // have one yet; transitions are only scheduled for rides with a driver.
+    for (uint64_t i = 0; i < header.rideCount; i++) {
+        const RideRecord& record = rideRecords[i];
+        if (record.riderId < 1 || (uint64_t)record.riderId > header.riderCount || record.driverId < 0 ||
+            (uint64_t)record.driverId > header.driverCount || record.status < Ride::REQUESTED || 
+            record.status > Ride::CANCELLED || record.vehicle < ANY_VEHICLE || record.vehicle >= VEHICLE_CLASS_COUNT) return false;
+        bool underWay = record.status == Ride::DRIVER_ASSIGNED || record.status == Ride::PICKUP_REACHED || 
+                        record.status == Ride::IN_PROGRESS;
+        if ((underWay && record.driverId == 0) || (record.status == Ride::REQUESTED && record.driverId != 0)) return false;
+        if (record.driverId != 0 && driverRecords[record.driverId - 1].status != Driver::ON_TRIP) return false;
+    }
+    for (uint64_t i = 0; i < header.transitionCount; i++) {
+        const TransitionRecord& record = transitionRecords[i];
+        if (record.ride >= header.rideCount || rideRecords[record.ride].driverId == 0 ||
+            (record.next != Ride::PICKUP_REACHED && record.next != Ride::IN_PROGRESS && 
+             record.next != Ride::COMPLETED)) return false;
+    }
+    for (uint64_t i = 0; i < header.pendingCount; i++) {
+        if (pendingRecords[i] >= header.rideCount || rideRecords[pendingRecords[i]].status != Ride::REQUESTED) return false;
+    }
+    
+    // Each order section must list its drivers exactly once: every driver in
+    // the status order, every idle one in the index and pool orders.
+    uint64_t idle = 0;
+    for (uint64_t i = 0; i < header.driverCount; i++) idle += driverRecords[i].status == Driver::AVAILABLE;
+    if (idle != header.indexedCount) return false;
+    auto isOrder = [&](const uint32_t* order, uint64_t count, bool idleOnly) {
+        vector<bool> seen(header.driverCount, false);
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t driver = order[i];
+            if (driver >= header.driverCount || seen[driver] || 
+                (idleOnly && driverRecords[driver].status != Driver::AVAILABLE)) return false;
+            seen[driver] = true;
+        }
+        return true;
+    };
+    if (!isOrder(statusOrder, header.driverCount, false) || !isOrder(indexOrder, header.indexedCount, true) ||
+        !isOrder(poolOrder, header.indexedCount, true)) return false;
+    if (header.engine != TICK_ENGINE && header.engine != EVENT_ENGINE) return false;
+    if (header.dispatchWindow < 0 || header.dispatchCandidates < 1 || 
+        (header.pendingCount > 0 && header.dispatchWindow == 0)) return false;
+    if (!(header.surge > 0) || (header.keyframeCount > 0 && header.ticksPerHour < 1)) return false;
+    for (uint64_t i = 0; i < header.keyframeCount; i++) {
+        if (!stringInPool(keyframeRecords[i].name, header.stringBytes)) return false;
+    }
+    if (header.zoneSize != 0 && !(header.zoneSize > 0 && 
+        ZoneHeatmap::zoneCountFor(driverIndex, header.zoneSize) == (double)header.zoneCount)) return false;
+    if (header.zoneSize == 0 && header.zoneCount != 0) return false;
+    SimulationStats restoredStats;
+    const char* statsData = data + statsOffset;
+    if (!restoredStats.readFrom(statsData, statsData + header.statsBytes)) return false;
+    
+    for (auto rider : riders) delete rider;
+    for (auto driver : drivers) delete driver;
+    riders.clear();
+    drivers.clear();
+    driverStore = DriverStore();
+    this->strings = StringTable();
+    driverIndex = SpatialIndex(MAP_SIZE, MAP_SIZE, GRID_CELL_SIZE);
+    vehiclePools.assign(VEHICLE_CLASS_COUNT, SpatialIndex(MAP_SIZE, MAP_SIZE, GRID_CELL_SIZE, 1));
+    activeRides = SlotMap<Ride>();
+    schedule = decltype(schedule)();
+    pendingRides.clear();
+    candidateIndex.clear();
+    completedRides.clear(restoredStats.getCompletedRides());
+    stats = restoredStats;
+    
+    auto text = [strings](const SnapshotString& ref) { return string(strings + ref.offset, ref.length); };
+    riders.reserve(header.riderCount);
+    for (uint64_t i = 0; i < header.riderCount; i++) {
+        const RiderRecord& record = riderRecords[i];
+        Rider* rider = new Rider(record.id, text(record.name), Location(record.x, record.y), &journal);
+        rider->balance = record.balance;
+        rider->hasActiveRide = record.hasActiveRide != 0;
+        riders.push_back(rider);
+    }
+    
+    drivers.reserve(header.driverCount);
+    driverStore.reserve(header.driverCount);
+    for (uint64_t i = 0; i < header.driverCount; i++) {
+        const DriverRecord& record = driverRecords[i];
+        VehicleClass vehicle = vehicleClassNamed(strings + record.vehicleType.offset, record.vehicleType.length);
+        Driver* driver = new Driver(driverStore, this->strings, record.id, text(record.name), Location(record.x, record.y),
+                                    vehicle, text(record.licensePlate), &journal);
+        driver->earnings = record.earnings;
+        driver->rating = record.rating;
+        driver->totalTrips = record.totalTrips;
+        driverStore.speed[driver->slot] = record.speed;
+        driverStore.targetX[driver->slot] = record.targetX;
+        driverStore.targetY[driver->slot] = record.targetY;
+        driver->setStatus((Driver::Status)record.status);
+        driver->attachIndex(&driverIndex, &vehiclePools[vehicle]);
+        driver->attachRoads(roads.get());
+        drivers.push_back(driver);
+    }
+    
+    // Put the status lists and the index buckets back in the order they were
+    // saved in, so sampling and scans pick the same drivers as before.
+    driverStore.orderStatusSlots(statusOrder, header.driverCount);
+    for (uint64_t i = 0; i < header.indexedCount; i++) {
+        driverIndex.remove(drivers[indexOrder[i]]);
+        vehiclePools[drivers[poolOrder[i]]->getVehicleClass()].remove(drivers[poolOrder[i]]);
+    }
+    for (uint64_t i = 0; i < header.indexedCount; i++) {
+        driverIndex.insert(drivers[indexOrder[i]]);
+        vehiclePools[drivers[poolOrder[i]]->getVehicleClass()].insert(drivers[poolOrder[i]]);
+    }
+    
+    vector<RideHandle> handles;
+    handles.reserve(header.rideCount);
+    activeRides.reserve(header.rideCount);
+    for (uint64_t i = 0; i < header.rideCount; i++) {
+        const RideRecord& record = rideRecords[i];
+        Ride ride(record.id, *riders[record.riderId - 1], Location(record.pickupX, record.pickupY),
+                  Location(record.destinationX, record.destinationY), record.requestedAt, &journal);
+        ride.driverId = record.driverId;
+        ride.status = (Ride::RideStatus)record.status;
+        ride.fare = record.fare;
+        ride.distance = record.distance;
+        ride.arrived = record.arrived != 0;
+        ride.vehicle = (VehicleClass)record.vehicle;
+        ride.pickedUpAt = record.pickedUpAt;
+        ride.completedAt = record.completedAt;
+        handles.push_back(activeRides.insert(ride));
+    }
+    for (uint64_t i = 0; i < header.transitionCount; i++) {
+        const TransitionRecord& record = transitionRecords[i];
+        schedule.push(ScheduledTransition{record.tick, record.sequence, handles[record.ride], 
+                                          (Ride::RideStatus)record.next, Location(record.driverX, record.driverY)});
+    }
+    for (uint64_t i = 0; i < header.pendingCount; i++) {
+        pendingRides.push_back(handles[pendingRecords[i]]);
+    }
+    
+    nextRiderId = header.nextRiderId;
+    nextDriverId = header.nextDriverId;
+    nextRideId = header.nextRideId;
+    currentTick = header.currentTick;
+    journal.setTick(currentTick);
+    engine = (Engine)header.engine;
+    scheduleSequence = header.scheduleSequence;
+    dispatchWindow = header.dispatchWindow;
+    dispatchCandidates = header.dispatchCandidates;
+    dispatchStats.windows = header.dispatchWindows;
+    dispatchStats.matched = header.dispatchMatched;
+    dispatchStats.unmatched = header.dispatchUnmatched;
+    dispatchStats.largestBatch = header.dispatchLargestBatch;
+    dispatchStats.totalMillis = header.dispatchTotalMillis;
+    dispatchStats.maxMillis = header.dispatchMaxMillis;
+    seed = header.seed;
+    demandStream = RandomStream(seed, DEMAND_STREAM);
+    demandStream.setCounter(header.demandCounter);
+    scenarioStream = RandomStream(seed, SCENARIO_STREAM);
+    scenarioStream.setCounter(header.scenarioCounter);
+    surge = header.surge;
+    demandSchedule = DemandSchedule(max(1, header.ticksPerHour));
+    for (uint64_t i = 0; i < header.keyframeCount; i++) {
+        const KeyframeRecord& record = keyframeRecords[i];
+        demandSchedule.add(record.hour, ScenarioProfile{text(record.name), record.driverOnlineRate,
+                                                        record.rideRequestRate, record.surge});
+    }
+    setZones(header.zoneSize, header.repositioning != 0);
+    if (zones.enabled()) zones.restoreState(zoneState, header.peakSurge);
+    repositionMoves = header.repositionMoves;
+    return true;
+}
+
+bool RideSharingSimulator::saveSnapshot(const string& path) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerBytes = sizeof(header);
+    header.seed = seed;
+    header.currentTick = currentTick;
+    header.scheduleSequence = scheduleSequence;
+    header.demandCounter = demandStream.getCounter();
+    header.scenarioCounter = scenarioStream.getCounter();
+    header.nextRiderId = nextRiderId;
+    header.nextDriverId = nextDriverId;
+    header.nextRideId = nextRideId;
+    header.engine = engine;
+    header.dispatchWindow = dispatchWindow;
+    header.dispatchCandidates = dispatchCandidates;
+    header.dispatchWindows = dispatchStats.windows;
+    header.dispatchMatched = dispatchStats.matched;
+    header.dispatchUnmatched = dispatchStats.unmatched;
+    header.dispatchLargestBatch = dispatchStats.largestBatch;
+    header.dispatchTotalMillis = dispatchStats.totalMillis;
+    header.dispatchMaxMillis = dispatchStats.maxMillis;
+    header.surge = surge;
+    header.zoneSize = zones.enabled() ? zones.getZoneSize() : 0;
+    header.peakSurge = zones.getPeakSurge();
+    header.ticksPerHour = demandSchedule.getTicksPerHour();
+    header.repositioning = repositioning;
+    header.repositionMoves = repositionMoves;
+    
+    vector<char> strings;
+    auto intern = [&strings](const string& text) {
+        SnapshotString ref{(uint32_t)strings.size(), (uint32_t)text.size()};
+        strings.insert(strings.end(), text.begin(), text.end());
+        return ref;
+    };
+    
+    // Value-initialised records have zeroed padding, so equal worlds hash equally.
+    vector<DriverRecord> driverRecords(drivers.size());
+    for (size_t i = 0; i < drivers.size(); i++) {
+        const Driver& driver = *drivers[i];
+        DriverRecord& record = driverRecords[i];
+        record.id = driver.id;
+        record.totalTrips = driver.totalTrips;
+        record.status = driver.getStatus();
+        record.name = intern(driver.getName());
+        record.vehicleType = intern(driver.getVehicleType());
+        record.licensePlate = intern(driver.getLicensePlate());
+        record.x = driverStore.x[driver.slot];
+        record.y = driverStore.y[driver.slot];
+        record.targetX = driverStore.targetX[driver.slot];
+        record.targetY = driverStore.targetY[driver.slot];
+        record.speed = driverStore.speed[driver.slot];
+        record.earnings = driver.earnings;
+        record.rating = driver.rating;
+    }
+    
+    vector<RiderRecord> riderRecords(riders.size());
+    for (size_t i = 0; i < riders.size(); i++) {
+        const Rider& rider = *riders[i];
+        RiderRecord& record = riderRecords[i];
+        record.id = rider.id;
+        record.hasActiveRide = rider.hasActiveRide;
+        record.name = intern(rider.name);
+        record.x = rider.location.getX();
+        record.y = rider.location.getY();
+        record.balance = rider.balance;
+    }
+    
+    vector<RideRecord> rideRecords(activeRides.size());
+    for (size_t i = 0; i < activeRides.size(); i++) {
+        const Ride& ride = activeRides[i];
+        RideRecord& record = rideRecords[i];
+        record.id = ride.id;
+        record.riderId = ride.riderId;
+        record.driverId = ride.driverId;
+        record.status = ride.status;
+        record.arrived = ride.arrived;
+        record.vehicle = ride.vehicle;
+        record.pickupX = ride.pickup.getX();
+        record.pickupY = ride.pickup.getY();
+        record.destinationX = ride.destination.getX();
+        record.destinationY = ride.destination.getY();
+        record.fare = ride.fare;
+        record.distance = ride.distance;
+        record.requestedAt = ride.requestedAt;
+        record.pickedUpAt = ride.pickedUpAt;
+        record.completedAt = ride.completedAt;
+    }
+    
+    vector<TransitionRecord> transitionRecords;
+    auto pending = schedule;
+    while (!pending.empty()) {
+        const ScheduledTransition& due = pending.top();
+        if (activeRides.contains(due.ride)) {
+            TransitionRecord record = {};
+            record.tick = due.tick;
+            record.sequence = due.sequence;
+            record.ride = activeRides.indexOf(due.ride);
+            record.next = due.next;
+            record.driverX = due.driverAt.getX();
+            record.driverY = due.driverAt.getY();
+            transitionRecords.push_back(record);
+        }
+        pending.pop();
+    }
+    
+    vector<uint32_t> pendingRecords;
+    for (RideHandle handle : pendingRides) {
+        if (activeRides.contains(handle)) pendingRecords.push_back(activeRides.indexOf(handle));
+    }
+    
+    vector<KeyframeRecord> keyframeRecords(demandSchedule.getKeyframes().size());
+    for (size_t i = 0; i < keyframeRecords.size(); i++) {
+        const DemandSchedule::Keyframe& keyframe = demandSchedule.getKeyframes()[i];
+        KeyframeRecord& record = keyframeRecords[i];
+        record.hour = keyframe.hour;
+        record.name = intern(keyframe.profile.name);
+        record.driverOnlineRate = keyframe.profile.driverOnlineRate;
+        record.rideRequestRate = keyframe.profile.rideRequestRate;
+        record.surge = keyframe.profile.surge;
+    }
+    
+    vector<float> zoneState;
+    zones.saveState(zoneState);
+    
+    vector<uint32_t> statusOrder;
+    statusOrder.reserve(drivers.size());
+    for (unsigned char status = Driver::OFFLINE; status <= Driver::ON_TRIP; status++) {
+        const vector<int>& slots = driverStore.slotsWithStatus(status);
+        statusOrder.insert(statusOrder.end(), slots.begin(), slots.end());
+    }
+    vector<uint32_t> indexOrder, poolOrder;
+    auto appendOrder = [](const SpatialIndex& index, vector<uint32_t>& order) {
+        for (int cell = 0; cell < index.getCols() * index.getRows(); cell++) {
+            for (const Driver* driver : index.cellDrivers(cell)) order.push_back(driver->getId() - 1);
+        }
+    };
+    appendOrder(driverIndex, indexOrder);
+    for (const SpatialIndex& pool : vehiclePools) appendOrder(pool, poolOrder);
+    
+    vector<char> statsBlob;
+    stats.appendTo(statsBlob);
+    
+    header.driverCount = driverRecords.size();
+    header.riderCount = riderRecords.size();
+    header.rideCount = rideRecords.size();
+    header.transitionCount = transitionRecords.size();
+    header.pendingCount = pendingRecords.size();
+    header.keyframeCount = keyframeRecords.size();
+    header.zoneCount = zones.getZoneCount();
+    header.indexedCount = indexOrder.size();
+    header.statsBytes = statsBlob.size();
+    header.stringBytes = strings.size();
+    
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    uint64_t checksum = seed;
+    uint64_t payload = 0;
+    auto writeSection = [&](const void* data, size_t bytes) {
+        static const char zeros[8] = {};
+        checksum = snapshotChecksum((const char*)data, bytes, checksum);
+        ok = ok && fwrite(data, 1, bytes, out) == bytes;
+        ok = ok && fwrite(zeros, 1, padded(bytes) - bytes, out) == padded(bytes) - bytes;
+        payload += padded(bytes);
+    };
+    writeSection(driverRecords.data(), driverRecords.size() * sizeof(DriverRecord));
+    writeSection(riderRecords.data(), riderRecords.size() * sizeof(RiderRecord));
+    writeSection(rideRecords.data(), rideRecords.size() * sizeof(RideRecord));
+    writeSection(transitionRecords.data(), transitionRecords.size() * sizeof(TransitionRecord));
+    writeSection(pendingRecords.data(), pendingRecords.size() * sizeof(uint32_t));
+    writeSection(keyframeRecords.data(), keyframeRecords.size() * sizeof(KeyframeRecord));
+    writeSection(zoneState.data(), zoneState.size() * sizeof(float));
+    writeSection(statusOrder.data(), statusOrder.size() * sizeof(uint32_t));
+    writeSection(indexOrder.data(), indexOrder.size() * sizeof(uint32_t));
+    writeSection(poolOrder.data(), poolOrder.size() * sizeof(uint32_t));
+    writeSection(statsBlob.data(), statsBlob.size());
+    writeSection(strings.data(), strings.size());
+    
+    header.payloadBytes = payload;
+    header.checksum = checksum;
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+bool RideSharingSimulator::exportState(const string& prefix, ExportFormat format) const {
+    const char* extension = format == CSV_EXPORT ? ".csv" : ".col";
+    bool ok = exportDrivers(prefix + "drivers" + extension, format);
+    ok = exportRiders(prefix + "riders" + extension, format) && ok;
+    ok = exportActiveRides(prefix + "rides" + extension, format) && ok;
+    ok = exportCompletedRides(prefix + "completed" + extension, format) && ok;
+    return ok;
+}
+
+void RideSharingSimulator::setStateExport(const string& prefix, ExportFormat format, int everyTicks) {
+    exportPrefix = prefix;
+    exportFormat = format;
+    exportEvery = max(0, everyTicks);
+}
+
+bool RideSharingSimulator::exportDrivers(const string& path, ExportFormat format) const {
+    ExportBuffer out;
+    if (!out.open(path)) return false;
+    typedef ColumnarWriter C;
+    C table(out);
+    if (format == CSV_EXPORT) {
+        out.put("id,name,vehicle,plate,status,x,y,speed,earnings,rating,trips\n");
+    } else {
+        table.schema({{"id", C::I32}, {"name", C::STR}, {"vehicle", C::I32}, {"plate", C::STR}, {"status", C::I32},
+                      {"x", C::F64}, {"y", C::F64}, {"speed", C::F64}, {"earnings", C::F64}, {"rating", C::F64},
+                      {"trips", C::I32}});
+    }
+    for (const Driver* driver : drivers) {
+        Driver::Status status = driver->getStatus();
+        if (status == Driver::DEPARTED) continue;
+        int slot = driver->slot;
+        if (format == CSV_EXPORT) {
+            out.field(driver->getId()).field(driver->getName()).field(driver->getVehicleType())
+               .field(driver->getLicensePlate()).field(Driver::statusName(status))
+               .field(driverStore.x[slot], 2).field(driverStore.y[slot], 2).field(driverStore.speed[slot], 2)
+               .field(driver->getEarnings(), 2).field(driver->getRating(), 2).field(driver->getTotalTrips());
+            out.endRow();
+        } else {
+            table.field(driver->getId()).field(driver->getName()).field((int32_t)driver->getVehicleClass())
+                 .field(driver->getLicensePlate()).field((int32_t)status)
+                 .field(driverStore.x[slot]).field(driverStore.y[slot]).field(driverStore.speed[slot])
+                 .field(driver->getEarnings()).field(driver->getRating()).field(driver->getTotalTrips());
+            table.endRow();
+        }
+    }
+    if (format == COLUMNAR_EXPORT) table.finish();
+    return out.close();
+}
+
+bool RideSharingSimulator::exportRiders(const string& path, ExportFormat format) const {
+    ExportBuffer out;
+    if (!out.open(path)) return false;
+    typedef ColumnarWriter C;
+    C table(out);
+    if (format == CSV_EXPORT) {
+        out.put("id,name,x,y,balance,on_ride\n");
+    } else {
+        table.schema({{"id", C::I32}, {"name", C::STR}, {"x", C::F64}, {"y", C::F64}, {"balance", C::F64},
+                      {"on_ride", C::I32}});
+    }
+    for (const Rider* rider : riders) {
+        if (rider->departed) continue;
+        Location at = rider->getLocation();
+        if (format == CSV_EXPORT) {
+            out.field(rider->getId()).field(rider->getName()).field(at.getX(), 2).field(at.getY(), 2)
+               .field(rider->getBalance(), 2).field(rider->hasRide() ? 1 : 0);
+            out.endRow();
+        } else {
+            table.field(rider->getId()).field(rider->getName()).field(at.getX()).field(at.getY())
+                 .field(rider->getBalance()).field(rider->hasRide() ? 1 : 0);
+            table.endRow();
+        }
+    }
+    if (format == COLUMNAR_EXPORT) table.finish();
+    return out.close();
+}
+
+bool RideSharingSimulator::exportActiveRides(const string& path, ExportFormat format) const {
+    ExportBuffer out;
+    if (!out.open(path)) return false;
+    typedef ColumnarWriter C;
+    C table(out);
+    if (format == CSV_EXPORT) {
+        out.put("id,rider,driver,status,vehicle,pickup_x,pickup_y,destination_x,destination_y,fare,distance,"
+                "requested_at\n");
+    } else {
+        table.schema({{"id", C::I32}, {"rider", C::I32}, {"driver", C::I32}, {"status", C::I32}, 
+                      {"vehicle", C::I32}, {"pickup_x", C::F64}, {"pickup_y", C::F64}, {"destination_x", C::F64}, 
+                      {"destination_y", C::F64}, {"fare", C::F64}, {"distance", C::F64}, {"requested_at", C::I64}});
+    }
+    for (const Ride& ride : activeRides) {
+        Location pickup = ride.getPickup(), destination = ride.getDestination();
+        if (format == CSV_EXPORT) {
+            out.field(ride.getId()).field(ride.getRiderId()).field(ride.getDriverId())
+               .field(Ride::statusName(ride.getStatus())).field(vehicleClassName(ride.getVehicleClass()))
+               .field(pickup.getX(), 2).field(pickup.getY(), 2).field(destination.getX(), 2)
+               .field(destination.getY(), 2).field(ride.getFare(), 2).field(ride.getDistance(), 2)
+               .field(ride.getRequestedAt());
+            out.endRow();
+        } else {
+            table.field(ride.getId()).field(ride.getRiderId()).field(ride.getDriverId())
+                 .field((int32_t)ride.getStatus()).field((int32_t)ride.getVehicleClass())
+                 .field(pickup.getX()).field(pickup.getY()).field(destination.getX()).field(destination.getY())
+                 .field(ride.getFare()).field(ride.getDistance()).field((int64_t)ride.getRequestedAt());
+            table.endRow();
+        }
+    }
+    if (format == COLUMNAR_EXPORT) table.finish();
+    return out.close();
+}
+
+bool RideSharingSimulator::exportCompletedRides(const string& path, ExportFormat format) const {
+    ExportBuffer out;
+    if (!out.open(path)) return false;
+    typedef ColumnarWriter C;
+    C table(out);
+    if (format == CSV_EXPORT) {
+        out.put("id,rider,driver,pickup_x,pickup_y,destination_x,destination_y,fare,distance,"
+                "requested_at,picked_up_at,completed_at\n");
+    } else {
+        table.schema({{"id", C::I32}, {"rider", C::I32}, {"driver", C::I32}, {"pickup_x", C::F64}, 
+                      {"pickup_y", C::F64}, {"destination_x", C::F64}, {"destination_y", C::F64}, 
+                      {"fare", C::F64}, {"distance", C::F64}, {"requested_at", C::I64}, 
+                      {"picked_up_at", C::I64}, {"completed_at", C::I64}});
+    }
+    bool read = completedRides.forEachChunk([&](const RideArchive::Chunk& chunk) {
+        if (format == CSV_EXPORT) {
+            for (size_t i = 0; i < chunk.size; i++) {
+                out.field(chunk.id[i]).field(chunk.riderId[i]).field(chunk.driverId[i])
+                   .field(chunk.pickupX[i], 2).field(chunk.pickupY[i], 2)
+                   .field(chunk.destinationX[i], 2).field(chunk.destinationY[i], 2)
+                   .field(chunk.fare[i], 2).field(chunk.distance[i], 2)
+                   .field(chunk.requestedAt[i]).field(chunk.pickedUpAt[i]).field(chunk.completedAt[i]);
+                out.endRow();
+            }
+            return;
+        }
+        table.beginGroup(chunk.size);
+        table.column(chunk.id, chunk.size);
+        table.column(chunk.riderId, chunk.size);
+        table.column(chunk.driverId, chunk.size);
+        table.column(chunk.pickupX, chunk.size);
+        table.column(chunk.pickupY, chunk.size);
+        table.column(chunk.destinationX, chunk.size);
+        table.column(chunk.destinationY, chunk.size);
+        table.column(chunk.fare, chunk.size);
+        table.column(chunk.distance, chunk.size);
+        table.column(chunk.requestedAt, chunk.size);
+        table.column(chunk.pickedUpAt, chunk.size);
+        table.column(chunk.completedAt, chunk.size);
+    });
+    if (format == COLUMNAR_EXPORT) table.finish();
+    return out.close() && read;
+}
+
+bool RideSharingSimulator::loadSnapshot(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    bool ok = restoreSnapshot((const char*)mapped, size);
+    munmap(mapped, size);
+    return ok;
+}
+
+const ScenarioProfile* RideSharingSimulator::findScenario(const string& name) const {
+    for (const ScenarioProfile& profile : scenarios) {
+        if (profile.name == name) return &profile;
+    }
+    return nullptr;
+}
+
+void RideSharingSimulator::setScenario(const string& scenarioName, long onlineDrivers) {
+    const ScenarioProfile* scenario = findScenario(scenarioName);
+    if (!scenario) {
+        journal.narrate() << " Unknown scenario: " << scenarioName;
+        return;
+    }
+    surge = scenario->surge;
+    
+    for (Driver::Status status : {Driver::AVAILABLE, Driver::ON_TRIP}) {
+        driverStore.forEachWithStatus(status, [this](int slot) { driverAtSlot(slot).goOffline(); });
+    }
+    
+   
+    int driversToGoOnline = onlineDrivers >= 0 ? min(onlineDrivers, (long)getDriverCount()) 
+                                               : (long)(getDriverCount() * scenario->driverOnlineRate);
+    journal.narrate() << "\nSETTING SCENARIO: " << scenarioName;
+    journal.narrate() << " Expected online drivers: " << driversToGoOnline << "/" << getDriverCount();
+    journal.narrate() << " Surge multiplier: " << scenario->surge << "x";
+    
+   
+    int onlineCount = 0;
+    for (; onlineCount < driversToGoOnline; onlineCount++) {
+        sampleWithStatus(Driver::OFFLINE).goOnline();
+    }
+    
+    journal.narrate() << onlineCount << " drivers are now online";
+}
+
+void RideSharingSimulator::showAvailableDrivers() {
+    cout << "\n AVAILABLE DRIVERS:\n";
+    cout << "==========================================\n";
+    
+    size_t availableCount = driverStore.countWithStatus(Driver::AVAILABLE);
+    driverStore.forEachWithStatus(Driver::AVAILABLE, [this](int slot) {
+        const Driver& driver = driverAtSlot(slot);
+        cout  << driver.getName() 
+             << " | " << driver.getVehicleType()
+             << " | " << driver.getLicensePlate()
+             << " | Location: " << driver.getLocation().toString()
+             << " | Rating: " << fixed << setprecision(1) << driver.getRating() 
+             << " | Trips: " << driver.getTotalTrips() << endl;
+    });
+    
+    if (availableCount == 0) {
+        cout << " No drivers available at the moment\n";
+        cout << " Try setting a scenario or use option 7 to set drivers online\n";
+    } else {
+        cout << "Total available: " << availableCount << " drivers\n";
+    }
+}
+
+void RideSharingSimulator::showAllDrivers() {
+    cout << "\n ALL DRIVERS STATUS:\n";
+    cout << "==========================================\n";
+    
+    for (Driver* driver : drivers) {
+        Driver::Status status = driver->getStatus();
+        if (status == Driver::DEPARTED) continue;
+        
+        cout << " " << driver->getName() 
+             << " | " << driver->getStatusString()
+             << " | " << driver->getVehicleType()
+             << " | Location: " << driver->getLocation().toString();
+        
+        if (status == Driver::ON_TRIP) {
+            cout << " |  On Trip";
+        } else if (status == Driver::AVAILABLE) {
+            cout << " |  Available";
+        }
+        cout << endl;
+    }
+    
+    cout << "\n DRIVER SUMMARY:\n";
+    size_t available = driverStore.countWithStatus(Driver::AVAILABLE);
+    size_t onTrip = driverStore.countWithStatus(Driver::ON_TRIP);
+    cout << " Available: " << available << endl;
+    cout << " On Trip: " << onTrip << endl;
+    cout << " Offline: " << driverStore.countWithStatus(Driver::OFFLINE) << endl;
+    cout << " Online Rate: " << (available + onTrip) * 100 / max<size_t>(1, getDriverCount()) << "%\n";
+}
+
+void RideSharingSimulator::showRiders() {
+    cout << "\n RIDERS:\n";
+    cout << "==========================================\n";
+    for (Rider* rider : riders) {
+        cout << rider->getName() 
+             << " | Location: " << rider->getLocation().toString()
+             << " | Balance: ₹" << fixed << setprecision(2) << rider->getBalance()
+             << " | " << (rider->hasRide() ? "🚕 On trip" : "✅ Available") << endl;
+    }
+}
+
+void RideSharingSimulator::requestRide(int riderIndex) {
+    if (riderIndex < 0 || riderIndex >= (int)riders.size()) {
+        journal.narrate() << " Invalid rider selection!";
+        return;
+    }
+    
+    Rider* rider = riders[riderIndex];
+    if (rider->hasRide()) {
+        if (journal.narrating()) {
+            journal.narrate() << rider->getName() << " already has an active ride!";
+        }
+        return;
+    }
+    
+    submitRide(*rider, rider->getLocation(), randomLocation(demandStream));
+}
+
+RideHandle RideSharingSimulator::openRide(Rider& rider, const Location& pickup, const Location& destination,
+                                          VehicleClass vehicle) {
+    ScopedPhase timer(metrics, PhaseMetrics::REQUEST);
+    int rideId = nextRideId;
+    nextRideId += rideIdStride;
+    RideHandle handle = activeRides.insert(Ride(rideId, rider, pickup, destination, currentTick, &journal, 
+                                                surge * zones.surgeAt(pickup), 
+                                                roads ? travelDistance(pickup, destination) : -1));
+    zones.recordRequest(pickup);
+    Ride& ride = *activeRides.get(handle);
+    ride.vehicle = vehicle;
+    
+    journal.record(EventJournal::RIDE_REQUESTED, ride.getId(), 0, rider.getId(), ride.getFare());
+    if (journal.narrating()) {
+        journal.narrate() << "\n RIDE REQUESTED:";
+        journal.narrate() << " From: " << rider.getName() << " at " << pickup.toString();
+        journal.narrate() << " To: " << destination.toString();
+        journal.narrate() << " Estimated fare: ₹" << fixed << setprecision(2) << ride.getFare();
+    }
+    return handle;
+}
+
+void RideSharingSimulator::submitRide(Rider& rider, const Location& pickup, const Location& destination,
+                                      VehicleClass vehicle) {
+    RideHandle handle = openRide(rider, pickup, destination, vehicle);
+    if (sharded) {
+        matchInShard(handle, rider);
+        return;
+    }
+    if (dispatchWindow > 0) {
+        rider.setRideStatus(true);
+        pendingRides.push_back(handle);
+        if (journal.narrating()) {
+            journal.narrate() << " Waiting for the next dispatch window (" << pendingRides.size() << " pending)";
+        }
+        return;
+    }
+    assignDriverToRide(handle);
+}
+
+void RideSharingSimulator::requestRandomRide() {
+    if (getRiderCount() == 0) return;
+    int index = demandStream.nextInt(riders.size());
+    while (riders[index]->departed) index = demandStream.nextInt(riders.size());
+    requestRide(index);
+}
+
+bool RideSharingSimulator::requestTrip(const TripTraceReader::Trip& trip) {
+    auto onMap = [](const Location& at) { 
+        return at.getX() >= 0 && at.getX() <= MAP_SIZE && at.getY() >= 0 && at.getY() <= MAP_SIZE; 
+    };
+    if (riders.empty() || !onMap(trip.pickup) || !onMap(trip.destination)) return false;
+    for (size_t probe = 0; probe < riders.size(); probe++) {
+        Rider& rider = *riders[traceRiderCursor];
+        traceRiderCursor = (traceRiderCursor + 1) % riders.size();
+        if (!rider.hasRide()) {
+            rider.setLocation(trip.pickup);
+            submitRide(rider, trip.pickup, trip.destination, trip.vehicle);
+            return true;
+        }
+    }
+    return false;
+}
+
+RideSharingSimulator::ReplayResult RideSharingSimulator::replayTrace(TripTraceReader& trace, long maxTicks) {
+    ReplayResult result;
+    if (trace.getOrigin() < 0) trace.setOrigin(currentTick);
+    long start = trace.getOrigin();
+    long stop = maxTicks < 0 ? LONG_MAX : currentTick + maxTicks;
+    TripTraceReader::Trip trip;
+    while (trace.next(trip)) {
+        long due = start + max(trip.tick, 0L);
+        if (due > stop) {
+            trace.unread(trip);
+            break;
+        }
+        if (due > currentTick) advanceTo(due);
+        if (requestTrip(trip)) {
+            result.requested++;
+        } else {
+            result.dropped++;
+        }
+    }
+    if (maxTicks >= 0) advanceTo(stop);
+    return result;
+}
+
+void RideSharingSimulator::assignDriverToRide(RideHandle handle) {
+    Ride* ride = activeRides.get(handle);
+    if (!ride) return;
+    ScopedPhase timer(metrics, PhaseMetrics::MATCHING);
+    const SpatialIndex& pool = poolFor(ride->getVehicleClass());
+    Driver* nearestDriver = nullptr;
+    if (!roads) {
+        nearestDriver = pool.nearest(ride->getPickup(), MAX_PICKUP_DISTANCE);
+    } else {
+        vector<Driver*> candidates = pool.kNearest(ride->getPickup(), ROAD_CANDIDATES, MAX_PICKUP_DISTANCE);
+        vector<double> costs;
+        pickupCosts(ride->getPickup(), candidates, costs);
+        size_t best = 0;
+        for (size_t i = 1; i < candidates.size(); i++) {
+            if (costs[i] < costs[best]) best = i;
+        }
+        if (!candidates.empty()) nearestDriver = candidates[best];
+    }
+    
+    if (nearestDriver) {
+        commitAssignment(handle, *nearestDriver);
+    } else {
+        cancelUnmatched(handle);
+    }
+}
+
+void RideSharingSimulator::dispatchPending() {
+    if (pendingRides.empty()) return;
+    ScopedPhase timer(metrics, PhaseMetrics::MATCHING);
+    auto start = chrono::steady_clock::now();
+    
+    map<tuple<double, double, int>, int> pickupGroups;
+    vector<int> groupOf(pendingRides.size(), -1);
+    vector<int> groupSize;
+    for (size_t i = 0; i < pendingRides.size(); i++) {
+        const Ride* ride = activeRides.get(pendingRides[i]);
+        if (!ride) continue;
+        auto key = make_tuple(ride->getPickup().getX(), ride->getPickup().getY(), (int)ride->getVehicleClass());
+        auto found = pickupGroups.emplace(key, groupSize.size());
+        if (found.second) groupSize.push_back(0);
+        groupOf[i] = found.first->second;
+        groupSize[groupOf[i]]++;
+    }
+    
+    if (candidateIndex.size() < drivers.size()) candidateIndex.resize(drivers.size(), -1);
+    vector<Driver*> candidates;
+    vector<vector<AuctionMatcher::Edge>> groupEdges(groupSize.size());
+    double maxCost = 0;
+    vector<double> costs;
+    for (auto& group : pickupGroups) {
+        Location pickup(get<0>(group.first), get<1>(group.first));
+        size_t wanted = dispatchCandidates + groupSize[group.second] - 1;
+        vector<Driver*> nearby = poolFor((VehicleClass)get<2>(group.first)).kNearest(pickup, wanted, MAX_PICKUP_DISTANCE);
+        pickupCosts(pickup, nearby, costs);
+        for (size_t i = 0; i < nearby.size(); i++) {
+            int& local = candidateIndex[nearby[i]->getId() - 1];
+            if (local < 0) {
+                local = candidates.size();
+                candidates.push_back(nearby[i]);
+            }
+            groupEdges[group.second].push_back(AuctionMatcher::Edge{local, costs[i]});
+            maxCost = max(maxCost, costs[i]);
+        }
+    }
+    
+    vector<int> offsets(1, 0);
+    vector<AuctionMatcher::Edge> edges;
+    edges.reserve(pendingRides.size() * dispatchCandidates);
+    for (size_t i = 0; i < pendingRides.size(); i++) {
+        if (groupOf[i] >= 0) {
+            const auto& shared = groupEdges[groupOf[i]];
+            edges.insert(edges.end(), shared.begin(), shared.end());
+        }
+        offsets.push_back(edges.size());
+    }
+    
+    vector<int> assignment = AuctionMatcher::solve(offsets, edges, candidates.size(), 
+                                                   MATCHING_EPSILON, 1.0 + 4.0 * maxCost);
+    for (Driver* driver : candidates) candidateIndex[driver->getId() - 1] = -1;
+    
+    for (size_t i = 0; i < pendingRides.size(); i++) {
+        if (!activeRides.contains(pendingRides[i])) continue;
+        if (assignment[i] >= 0) {
+            commitAssignment(pendingRides[i], *candidates[assignment[i]]);
+            dispatchStats.matched++;
+        } else {
+            cancelUnmatched(pendingRides[i]);
+            dispatchStats.unmatched++;
+        }
+    }
+    
+    double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    dispatchStats.windows++;
+    dispatchStats.largestBatch = max(dispatchStats.largestBatch, pendingRides.size());
+    dispatchStats.totalMillis += millis;
+    dispatchStats.maxMillis = max(dispatchStats.maxMillis, millis);
+    pendingRides.clear();
+}
+
+void RideSharingSimulator::updateSimulation() {
+    journal.setTick(++currentTick);
+    if (engine == EVENT_ENGINE) {
+        processDueTransitions();
+        if (zones.enabled()) refreshZones();
+        if (dispatchDue()) dispatchPending();
+        endTick();
+        return;
+    }
+    
+    {
+        ScopedPhase timer(metrics, PhaseMetrics::RIDE_UPDATE);
+        tickPool->parallelFor(activeRides.size(), RIDE_CHUNK, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                Ride& ride = activeRides[i];
+                if (ride.hasDriver()) ride.update(driverById(ride.getDriverId()), currentTick);
+            }
+        });
+    }
+    
+    // Settlement mutates shared state (earnings, balances, the spatial index), so it
+    // runs on this thread in pool order and the outcome is independent of thread count.
+    // The journal entries for this tick's ride updates go out in the same pass.
+    {
+        ScopedPhase timer(metrics, PhaseMetrics::SETTLEMENT);
+        for (size_t i = 0; i < activeRides.size();) {
+            Ride& ride = activeRides[i];
+            if (ride.hasUnjournaledUpdate()) {
+                ride.journalUpdate(driverById(ride.getDriverId()), riderById(ride.getRiderId()));
+            }
+            if (ride.awaitingSettlement()) {
+                ride.completeRide(driverById(ride.getDriverId()), riderById(ride.getRiderId()), currentTick);
+                recordCompletion(ride);
+                if (sharded) movedDrivers.push_back(ride.getDriverId());
+            }
+            
+            if (ride.isFinished()) {
+                activeRides.removeAt(i);
+            } else {
+                i++;
+            }
+        }
+    }
+    
+    if (zones.enabled()) refreshZones();
+    
+    {
+        ScopedPhase timer(metrics, PhaseMetrics::RIDE_UPDATE);
+        tickPool->parallelFor(driverStore.size(), DRIVER_CHUNK, [this](size_t begin, size_t end) {
+            driverStore.advanceRange(begin, end);
+        });
+    }
+    
+    // advance() moves drivers without touching the indexes, which only hold
+    // idle ones; the drivers repositioning are the idle ones that moved.
+    for (Driver* driver : repositioned) {
+        driver->setLocation(driver->getLocation());
+        if (sharded) movedDrivers.push_back(driver->getId());
+    }
+    
+    if (sharded) handOff();
+    if (dispatchDue()) dispatchPending();
+    endTick();
+}
+
+void RideSharingSimulator::setZones(double zoneSize, bool reposition) {
+    if (!zones.enabled() || zones.getZoneSize() != zoneSize) zones.configure(driverIndex, zoneSize);
+    repositioning = reposition && zones.enabled();
+    repositioned.clear();
+}
+
+void RideSharingSimulator::refreshZones() {
+    ScopedPhase timer(metrics, PhaseMetrics::ZONES);
+    zones.update(driverIndex);
+    repositioned.clear();
+    if (!repositioning || engine != TICK_ENGINE) return;
+    for (int zone = 0; zone < zones.getZoneCount(); zone++) {
+        int target = zones.getTarget(zone);
+        if (target == zone) continue;
+        int moves = zones.surplusFor(zone);
+        Location goal = zones.zoneCentre(target);
+        for (int cell : zones.cellsOf(zone)) {
+            for (Driver* driver : driverIndex.cellDrivers(cell)) {
+                if (moves-- <= 0) break;
+                driver->moveTowards(goal);
+                repositioned.push_back(driver);
+            }
+        }
+    }
+    repositionMoves += repositioned.size();
+}
+
+void RideSharingSimulator::endTick() {
+    metrics.endTick();
+    if (exportEvery > 0 && currentTick % exportEvery == 0 &&
+        !exportState(exportPrefix + "tick" + to_string(currentTick) + "-", exportFormat)) {
+        exportFailures++;
+    }
+    if (!metricsPath.empty() && chrono::steady_clock::now() - lastMetricsExport >= metricsInterval) {
+        exportMetrics();
+    }
+}
+
+bool RideSharingSimulator::exportMetrics() {
+    if (metricsPath.empty()) return false;
+    lastMetricsExport = chrono::steady_clock::now();
+    vector<PhaseMetrics::Gauge> gauges = {
+        {"tick", (double)currentTick},
+        {"active_rides", (double)activeRides.size()},
+        {"pending_rides", (double)pendingRides.size()},
+        {"available_drivers", (double)driverIndex.size()},
+        {"completed_rides", (double)stats.getCompletedRides()},
+        {"cancelled_rides", (double)stats.getCancelledRides()},
+    };
+    if (distanceCache.enabled()) {
+        gauges.push_back({"distance_cache_hits", (double)distanceCache.getHits()});
+        gauges.push_back({"distance_cache_misses", (double)distanceCache.getMisses()});
+        gauges.push_back({"distance_cache_evictions", (double)distanceCache.getEvictions()});
+    }
+    string temporary = metricsPath + ".tmp";
+    {
+        ofstream out(temporary, ios::trunc);
+        if (!out) return false;
+        if (metricsJson) {
+            metrics.writeJson(out, gauges);
+        } else {
+            metrics.writePrometheus(out, gauges);
+        }
+        if (!out) return false;
+    }
+    return rename(temporary.c_str(), metricsPath.c_str()) == 0;
+}
+
+void RideSharingSimulator::showActiveRides() {
+    cout << "\n ACTIVE RIDES:\n";
+    cout << "==========================================\n";
+    
+    if (activeRides.empty()) {
+        cout << "No active rides at the moment\n";
+        return;
+    }
+    
+    for (const Ride& ride : activeRides) {
+        cout << "Ride #" << ride.getId() 
+             << " | " << riderById(ride.getRiderId()).getName()
+             << " → " << (ride.hasDriver() ? driverById(ride.getDriverId()).getName() : "No driver")
+             << " | Status: " << ride.getStatusString()
+             << " | Fare: ₹" << fixed << setprecision(2) << ride.getFare() << endl;
+    }
+}
+
+void RideSharingSimulator::showStatistics() {
+    cout << "\n SIMULATION STATISTICS:\n";
+    cout << "==========================================\n";
+    cout << "Total Riders: " << riders.size() << endl;
+    cout << "Total Drivers: " << drivers.size() << endl;
+    cout << "Active Rides: " << activeRides.size() << endl;
+    cout << "Completed Rides: " << stats.getCompletedRides() << endl;
+    cout << "Cancelled Rides: " << stats.getCancelledRides() << endl;
+    cout << "Archived Rides: " << completedRides.size() << " (" << completedRides.getResidentRides() 
+         << " in memory, " << completedRides.getSpilledChunks() << " chunks / " 
+         << completedRides.getSpilledBytes() / (1024 * 1024) << " MB spilled";
+    if (completedRides.getOmittedRides() > 0) {
+        cout << "; " << completedRides.getOmittedRides() << " from before the restored snapshot not kept";
+    }
+    cout << ")" << endl;
+    
+    cout << "Total Driver Earnings: ₹" << fixed << setprecision(2) << stats.getTotalFares() << endl;
+    cout << " Total Trips Completed: " << stats.getCompletedRides() << endl;
+    cout << " Available Drivers Now: " << driverStore.countWithStatus(Driver::AVAILABLE) << endl;
+    
+    if (stats.getCompletedRides() > 0) {
+        cout << " Average Fare: ₹" << fixed << setprecision(2) << stats.getAverageFare() << endl;
+        printPercentiles(" Fare (₹)", stats.getFares());
+        printPercentiles(" Wait (ticks)", stats.getWaitTicks());
+        printPercentiles(" Trip (ticks)", stats.getTripTicks());
+    }
+}
+
+void RideSharingSimulator::printPercentiles(const string& label, const QuantileSketch& sketch) {
+    cout << label << " p50/p90/p99: " << fixed << setprecision(2) << sketch.quantile(0.50) 
+         << " / " << sketch.quantile(0.90) << " / " << sketch.quantile(0.99) << endl;
+}
+
+void RideSharingSimulator::setDriversOnlineManually() {
+    journal.narrate() << "\n SETTING DRIVERS ONLINE MANUALLY...";
+    size_t count = driverStore.countWithStatus(Driver::OFFLINE);
+    driverStore.forEachWithStatus(Driver::OFFLINE, [this](int slot) { driverAtSlot(slot).goOnline(); });
+    journal.narrate() << count << " drivers are now online";
+}
+
+void RideSharingSimulator::run() {
+    journal.flush();
+    cout << "================================================================================\n";
+    cout << "                   UBER/RAPIDO RIDE-SHARING SIMULATOR (DATA MODE)              \n";
+    cout << "================================================================================\n";
+    
+    bool running = true;
+    while (running) {
+        cout << "\n\n MAIN MENU:\n";
+        cout << "==========================================\n";
+        cout << "1. Show Available Drivers & Locations\n";
+        cout << "2. Show All Drivers Status\n";
+        cout << "3. Show Riders\n";
+        cout << "4. Request Random Ride\n";
+        cout << "5. Show Active Rides\n";
+        cout << "6. Show Statistics\n";
+        cout << "7. Set Scenario (Rush Hour/Moderate/Late Night/Weekend)\n";
+        cout << "8. Set All Drivers Online (NEW)\n";
+        cout << "9. Update Simulation (Advance Time)\n";
+        cout << "10. Add Random Ride Requests\n";
+        cout << "11. Save Snapshot\n";
+        cout << "12. Load Snapshot\n";
+        cout << "13. Export State (CSV/Columnar)\n";
+        cout << "0. Exit\n";
+        cout << "==========================================\n";
+        cout << "Choose option: ";
+        
+        int choice;
+        cin >> choice;
+        
+        switch(choice) {
+            case 1:
+                showAvailableDrivers();
+                break;
+            case 2:
+                showAllDrivers();
+                break;
+            case 3:
+                showRiders();
+                break;
+            case 4:
+                if (!riders.empty()) {
+                    requestRandomRide();
+                }
+                break;
+            case 5:
+                showActiveRides();
+                break;
+            case 6:
+                showStatistics();
+                break;
+            case 7:
+                {
+                    cout << "Choose scenario:\n";
+                    cout << "1. Rush Hour (80% drivers online)\n";
+                    cout << "2. Moderate (60% drivers online)\n"; 
+                    cout << "3. Late Night (30% drivers online)\n";
+                    cout << "4. Weekend (70% drivers online)\n";
+                    int sc;
+                    cin >> sc;
+                    string scenarios[] = {"rush-hour", "moderate", "late-night", "weekend"};
+                    if (sc >= 1 && sc <= 4) {
+                        setScenario(scenarios[sc-1]);
+                    } else {
+                        cout << " Invalid scenario choice!\n";
+                    }
+                }
+                break;
+            case 8:
+                setDriversOnlineManually();
+                break;
+            case 9:
+                updateSimulation();
+                journal.flush();
+                cout << " Simulation updated!\n";
+                break;
+            case 10:
+                {
+                    int numRequests = demandStream.nextInt(3) + 1; 
+                    cout << " Generating " << numRequests << " random ride requests...\n";
+                    for (int i = 0; i < numRequests; i++) {
+                        if (!riders.empty()) {
+                            requestRandomRide();
+                        }
+                    }
+                }
+                break;
+            case 11:
+            case 12:
+                {
+                    cout << "Snapshot file: ";
+                    string path;
+                    cin >> path;
+                    if (choice == 11) {
+                        cout << (saveSnapshot(path) ? " Snapshot saved to " : " Could not write snapshot ") << path << endl;
+                    } else if (loadSnapshot(path)) {
+                        cout << " Restored " << drivers.size() << " drivers, " << riders.size() << " riders and "
+                             << activeRides.size() << " active rides at tick " << currentTick << endl;
+                    } else {
+                        cout << " Not a valid snapshot: " << path << endl;
+                    }
+                }
+                break;
+            case 13:
+                {
+                    cout << "Format (1. CSV, 2. Columnar): ";
+                    int format;
+                    cin >> format;
+                    cout << "File prefix: ";
+                    string prefix;
+                    cin >> prefix;
+                    if (exportState(prefix, format == 2 ? COLUMNAR_EXPORT : CSV_EXPORT)) {
+                        cout << " Exported drivers, riders, rides and completed rides to " << prefix << "*\n";
+                    } else {
+                        cout << " Could not write export " << prefix << endl;
+                    }
+                }
+                break;
+            case 0:
+                running = false;
+                break;
+            default:
+                cout << " Invalid choice!\n";
+        }
+        
+        journal.flush();
+        sleep(1);
+    }
+    
+    cout << "\n================================================================================\n";
+    cout << "                         SIMULATION ENDED - FINAL STATISTICS                    \n";
+    cout << "================================================================================\n";
+    showStatistics();
+}
+
+void RideSharingSimulator::advanceTo(long tick) {
+    if (engine == TICK_ENGINE) {
+        while (currentTick < tick) updateSimulation();
+        return;
+    }
+    // The last tick always runs, as it does with the tick engine, so a run ends
+    // with its zones, exports and metrics at the same tick either way.
+    while (currentTick < tick) {
+        long next = schedule.empty() ? tick : min(schedule.top().tick, tick);
+        if (!pendingRides.empty() && dispatchWindow > 0) {
+            next = min(next, (currentTick / dispatchWindow + 1) * dispatchWindow);
+        }
+        if (exportEvery > 0) next = min(next, (currentTick / exportEvery + 1) * exportEvery);
+        if (zones.enabled()) next = currentTick + 1;
+        next = max(next, currentTick + 1);
+        metrics.skipTicks(next - currentTick - 1);
+        currentTick = next - 1;
+        updateSimulation();
+    }
+}
+
+bool RideSharingSimulator::setSchedule(const string& spec, int ticksPerHour) {
+    string keyframes = spec == "day" 
+        ? "0:late-night,6:moderate,8:rush-hour,10.5:moderate,17:rush-hour,20:moderate,22:late-night" : spec;
+    DemandSchedule parsed(ticksPerHour);
+    stringstream list(keyframes);
+    string item;
+    while (getline(list, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == string::npos) return false;
+        char* end = nullptr;
+        double hour = strtod(item.c_str(), &end);
+        if (end != item.c_str() + colon) return false;
+        const ScenarioProfile* profile = findScenario(item.substr(colon + 1));
+        if (!profile) return false;
+        parsed.add(hour, *profile);
+    }
+    if (parsed.empty()) return false;
+    demandSchedule = parsed;
+    return true;
+}
+
+void RideSharingSimulator::matchOnlineRate(double rate) {
+    if (getDriverCount() == 0) return;
+    long target = lround(getDriverCount() * rate);
+    long online = getDriverCount() - driverStore.countWithStatus(Driver::OFFLINE);
+    for (; online < target; online++) {
+        sampleWithStatus(Driver::OFFLINE).goOnline();
+    }
+    for (; online > target && driverStore.countWithStatus(Driver::AVAILABLE) > 0; online--) {
+        sampleWithStatus(Driver::AVAILABLE).goOffline();
+    }
+}
+
+int RideSharingSimulator::requestScheduledRides() {
+    if (demandSchedule.empty()) return 0;
+    ScenarioProfile now = demandSchedule.at(currentTick + 1);
+    surge = now.surge;
+    matchOnlineRate(now.driverOnlineRate);
+    if (riders.empty()) return 0;
+    
+    double mean = riders.size() * now.rideRequestRate / demandSchedule.getTicksPerHour();
+    size_t arrivals = demandStream.nextPoisson(mean);
+    arrivalBuffer.resize(3 * arrivals);
+    int* picks = arrivalBuffer.data();
+    int* column = picks + arrivals;
+    int* row = column + arrivals;
+    demandStream.fillInts(riders.size(), picks, arrivals);
+    demandStream.fillInts(18, column, arrivals);
+    demandStream.fillInts(18, row, arrivals);
+    
+    int requested = 0;
+    for (size_t i = 0; i < arrivals; i++) {
+        Rider& rider = *riders[picks[i]];
+        if (rider.hasRide()) continue;
+        submitRide(rider, rider.getLocation(), Location(column[i] + 1, row[i] + 1));
+        requested++;
+    }
+    return requested;
+}
+
+int RideSharingSimulator::runScheduledTicks(int ticks) {
+    int requested = 0;
+    for (int tick = 0; tick < ticks; tick++) {
+        requested += requestScheduledRides();
+        updateSimulation();
+    }
+    return requested;
+}
+
+int RideSharingSimulator::runTicks(int ticks, int requestsPerTick) {
+    if (requestsPerTick == 0) {
+        advanceTo(currentTick + ticks);
+        return 0;
+    }
+    int requested = 0;
+    for (int tick = 0; tick < ticks; tick++) {
+        for (int i = 0; i < requestsPerTick && !riders.empty(); i++) {
+            requestRandomRide();
+            requested++;
+        }
+        updateSimulation();
+    }
+    return requested;
+}
+
+size_t ShardedSimulation::shardOf(const Location& at) const {
+    int strip = (int)floor(at.getX() / stripWidth);
+    return min(max(strip, 0), (int)shards.size() - 1);
+}
+
+void ShardedSimulation::adoptHandoffs(size_t k) {
+    RideSharingSimulator& shard = *shards[k];
+    for (size_t from = 0; from < shards.size(); from++) {
+        Lane& inbound = lane(from, k);
+        inbound.rides.drain([&](RideTransfer&& transfer) { shard.adoptRide(transfer); });
+        inbound.drivers.drain([&](DriverTransfer&& transfer) { shard.addDriver(transfer); });
+    }
+}
+
+void ShardedSimulation::forwardHandoffs(size_t k) {
+    RideSharingSimulator& shard = *shards[k];
+    for (RideTransfer& transfer : shard.outgoingRides) {
+        lane(k, shardOf(transfer.ride.getDestination())).rides.push(std::move(transfer));
+    }
+    for (DriverTransfer& transfer : shard.outgoingDrivers) {
+        lane(k, shardOf(transfer.location)).drivers.push(std::move(transfer));
+    }
+    handoffs[k].rides += shard.outgoingRides.size();
+    handoffs[k].drivers += shard.outgoingDrivers.size();
+    shard.outgoingRides.clear();
+    shard.outgoingDrivers.clear();
+}
+
+void ShardedSimulation::matchAcrossEdges() {
+    for (size_t k = 0; k < shards.size(); k++) {
+        RideSharingSimulator& home = *shards[k];
+        vector<RideHandle> deferred;
+        deferred.swap(home.deferredRides);
+        for (RideHandle handle : deferred) {
+            const Ride* ride = home.activeRides.get(handle);
+            if (!ride) continue;
+            Location pickup = ride->getPickup();
+            VehicleClass vehicle = ride->getVehicleClass();
+            size_t best = k;
+            Driver* driver = home.poolFor(vehicle).nearest(pickup, RideSharingSimulator::MAX_PICKUP_DISTANCE);
+            double bestDistance = driver ? driver->getLocation().distanceTo(pickup) : HUGE_VAL;
+            auto consider = [&](size_t strip) {
+                Driver* candidate = shards[strip]->poolFor(vehicle).nearest(pickup, RideSharingSimulator::MAX_PICKUP_DISTANCE);
+                if (candidate && candidate->getLocation().distanceTo(pickup) < bestDistance) {
+                    best = strip;
+                    driver = candidate;
+                    bestDistance = candidate->getLocation().distanceTo(pickup);
+                }
+            };
+            for (size_t strip = k; strip-- > 0;) {
+                double edge = pickup.getX() - shards[strip]->regionMaxX;
+                if (edge >= bestDistance || edge > RideSharingSimulator::MAX_PICKUP_DISTANCE) break;
+                consider(strip);
+            }
+            for (size_t strip = k + 1; strip < shards.size(); strip++) {
+                double edge = shards[strip]->regionMinX - pickup.getX();
+                if (edge >= bestDistance || edge > RideSharingSimulator::MAX_PICKUP_DISTANCE) break;
+                consider(strip);
+            }
+            
+            if (!driver) {
+                home.cancelUnmatched(handle);
+            } else if (best == k) {
+                home.commitAssignment(handle, *driver);
+            } else {
+                RideTransfer transfer = home.releaseRide(*ride);
+                home.activeRides.remove(handle);
+                RideSharingSimulator& away = *shards[best];
+                away.commitAssignment(away.adoptRide(transfer), *driver);
+                boundaryMatches++;
+            }
+        }
+    }
+}
+
+void ShardedSimulation::settle() {
+    pool.parallelFor(shards.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) adoptHandoffs(k);
+    });
+}
+
+void ShardedSimulation::step(const function<long(RideSharingSimulator&, size_t)>& request) {
+    pool.parallelFor(shards.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            adoptHandoffs(k);
+            requested[k] += request(*shards[k], k);
+        }
+    });
+    matchAcrossEdges();
+    pool.parallelFor(shards.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            shards[k]->updateSimulation();
+            forwardHandoffs(k);
+        }
+    });
+}
+
+ShardedSimulation::ShardedSimulation(int shardCount, int numRiders, int numDrivers, uint64_t seed)
+    : handoffs(max(1, shardCount)), requested(max(1, shardCount), 0), pool(max(1, shardCount)),
+      stripWidth(RideSharingSimulator::MAP_SIZE / max(1, shardCount)), boundaryMatches(0) {
+    int count = max(1, shardCount);
+    for (int k = 0; k < count; k++) {
+        uint64_t shardSeed = seed ^ (0x9E3779B97F4A7C15ULL * (k + 1));
+        shards.emplace_back(new RideSharingSimulator(0, 0, EventJournal::QUIET, shardSeed));
+        shards[k]->setShard(k == 0 ? -HUGE_VAL : k * stripWidth, k == count - 1 ? HUGE_VAL : (k + 1) * stripWidth,
+                            k + 1, count);
+    }
+    for (int i = 0; i < count * count; i++) lanes.emplace_back(new Lane());
+    
+    for (int i = 0; i < numRiders; i++) {
+        RideSharingSimulator::RiderTransfer rider = RideSharingSimulator::sampleRider(seed, i);
+        shards[shardOf(rider.location)]->addRider(rider);
+    }
+    for (int i = 0; i < numDrivers; i++) {
+        DriverTransfer driver = RideSharingSimulator::sampleDriver(seed, i);
+        if (RideSharingSimulator::startsOnline(seed, i)) driver.status = Driver::AVAILABLE;
+        shards[shardOf(driver.location)]->addDriver(driver);
+    }
+}
+
+long ShardedSimulation::getRideHandoffs() const {
+    long total = 0;
+    for (const HandoffCounts& counts : handoffs) total += counts.rides;
+    return total;
+}
+
+long ShardedSimulation::getDriverHandoffs() const {
+    long total = 0;
+    for (const HandoffCounts& counts : handoffs) total += counts.drivers;
+    return total;
+}
+
+SimulationStats ShardedSimulation::getStats() const {
+    SimulationStats total;
+    for (const auto& shard : shards) total.merge(shard->getStats());
+    return total;
+}
+
+void ShardedSimulation::setScenario(const string& scenarioName) {
+    const ScenarioProfile* scenario = shards[0]->findScenario(scenarioName);
+    long drivers = 0;
+    for (const auto& shard : shards) drivers += shard->getDriverCount();
+    long online = scenario ? (long)(drivers * scenario->driverOnlineRate) : 0;
+    long before = 0;
+    for (auto& shard : shards) {
+        long upTo = before + shard->getDriverCount();
+        shard->setScenario(scenarioName, drivers ? online * upTo / drivers - online * before / drivers : 0);
+        before = upTo;
+    }
+}
+
+void ShardedSimulation::setZones(double zoneSize, bool reposition) {
+    for (auto& shard : shards) shard->setZones(zoneSize, reposition);
+}
+
+bool ShardedSimulation::setSchedule(const string& spec, int ticksPerHour) {
+    for (auto& shard : shards) {
+        if (!shard->setSchedule(spec, ticksPerHour)) return false;
+    }
+    return true;
+}
+
+long ShardedSimulation::runTicks(int ticks, int requestsPerTick) {
+    vector<long> quota(shards.size());
+    for (int tick = 0; tick < ticks; tick++) {
+        long riders = 0;
+        for (const auto& shard : shards) riders += shard->getRiderCount();
+        long before = 0;
+        for (size_t k = 0; k < shards.size(); k++) {
+            long upTo = before + shards[k]->getRiderCount();
+            quota[k] = riders ? requestsPerTick * upTo / riders - requestsPerTick * before / riders : 0;
+            before = upTo;
+        }
+        step([&](RideSharingSimulator& shard, size_t k) {
+            for (long i = 0; i < quota[k]; i++) shard.requestRandomRide();
+            return quota[k];
+        });
+    }
+    settle();
+    return accumulate(requested.begin(), requested.end(), 0L);
+}
+
+long ShardedSimulation::runScheduledTicks(int ticks) {
+    for (int tick = 0; tick < ticks; tick++) {
+        step([](RideSharingSimulator& shard, size_t) { return (long)shard.requestScheduledRides(); });
+    }
+    settle();
+    return accumulate(requested.begin(), requested.end(), 0L);
+}
+
+void ShardedSimulation::showStatistics() const {
+    SimulationStats stats = getStats();
+    size_t riders = 0, drivers = 0, available = 0, active = 0;
+    for (const auto& shard : shards) {
+        riders += shard->getRiderCount();
+        drivers += shard->getDriverCount();
+        available += shard->driverStore.countWithStatus(Driver::AVAILABLE);
+        active += shard->getActiveRideCount();
+    }
+    cout << "\n SIMULATION STATISTICS:\n";
+    cout << "==========================================\n";
+    cout << "Shards: " << shards.size() << " strips of " << fixed << setprecision(2) << stripWidth << " units\n";
+    cout << "Total Riders: " << riders << endl;
+    cout << "Total Drivers: " << drivers << endl;
+    cout << "Active Rides: " << active << endl;
+    cout << "Completed Rides: " << stats.getCompletedRides() << endl;
+    cout << "Cancelled Rides: " << stats.getCancelledRides() << endl;
+    cout << "Handoffs: " << getRideHandoffs() << " trips | " << getDriverHandoffs() << " drivers | "
+         << boundaryMatches << " requests matched across an edge\n";
+    if (shards[0]->zones.enabled()) {
+        long moves = 0;
+        double peak = 1.0;
+        for (const auto& shard : shards) {
+            moves += shard->repositionMoves;
+            peak = max(peak, shard->zones.getPeakSurge());
+        }
+        cout << "Zones: " << shards[0]->zones.getZoneCount() << " per shard | Peak surge: " << setprecision(2) 
+             << peak << "x | Repositioning moves: " << moves << endl;
+    }
+    cout << "Total Driver Earnings: ₹" << fixed << setprecision(2) << stats.getTotalFares() << endl;
+    cout << " Available Drivers Now: " << available << endl;
+    if (stats.getCompletedRides() > 0) {
+        cout << " Average Fare: ₹" << fixed << setprecision(2) << stats.getAverageFare() << endl;
+        shards[0]->printPercentiles(" Fare (₹)", stats.getFares());
+        shards[0]->printPercentiles(" Wait (ticks)", stats.getWaitTicks());
+        shards[0]->printPercentiles(" Trip (ticks)", stats.getTripTicks());
+    }
+}
+
+void RideService::dispatchLoop() {
+    vector<Request> batch;
+    batch.reserve(batchSize);
+    size_t idle = 0;
+    while (true) {
+        bool stopping = !dispatching.load(memory_order_acquire);
+        batch.clear();
+        if (queue.popBatch(batch, batchSize) == 0) {
+            if (stopping) return;
+            if (++idle < IDLE_SPINS) {
+                this_thread::yield();
+            } else {
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+            continue;
+        }
+        idle = 0;
+        
+        lock_guard<mutex> guard(world);
+        report.batches++;
+        for (const Request& request : batch) {
+            long cancelled = simulator.getStats().getCancelledRides();
+            TripTraceReader::Trip trip{simulator.getCurrentTick(), request.pickup, request.destination, request.vehicle};
+            if (!simulator.requestTrip(trip)) {
+                report.dropped++;
+                continue;
+            }
+            if (simulator.getStats().getCancelledRides() != cancelled) {
+                report.unmatched++;
+            } else {
+                report.matched++;
+            }
+            double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - request.submitted).count();
+            report.latency.add(max(micros, 0.001));
+        }
+    }
+}
+
+void RideService::clockLoop() {
+    auto next = chrono::steady_clock::now() + tickInterval;
+    while (running.load(memory_order_acquire)) {
+        this_thread::sleep_until(next);
+        next += tickInterval;
+        lock_guard<mutex> guard(world);
+        simulator.updateSimulation();
+        report.ticks++;
+    }
+}
+
+void RideService::frontendLoop() {
+    int fd = open(frontendPath.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    string pending;
+    char buffer[65536];
+    while (running.load(memory_order_acquire)) {
+        pollfd ready{fd, POLLIN, 0};
+        if (poll(&ready, 1, 100) <= 0) continue;
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes <= 0) break;
+        pending.append(buffer, bytes);
+        size_t start = 0, end;
+        while ((end = pending.find('\n', start)) != string::npos) {
+            submitLine(pending.substr(start, end - start));
+            start = end + 1;
+        }
+        pending.erase(0, start);
+    }
+    if (!pending.empty()) submitLine(pending);
+    close(fd);
+}
+
+void RideService::submitLine(const string& line) {
+    const char* at = line.c_str();
+    while (*at == ' ' || *at == '\t' || *at == '\r') at++;
+    if (*at == '\0') return;
+    double values[4];
+    for (int i = 0; i < 4; i++) {
+        while (*at == ',' || *at == ' ' || *at == '\t') at++;
+        char* end = nullptr;
+        values[i] = strtod(at, &end);
+        if (end == at) {
+            report.frontendMalformed++;
+            return;
+        }
+        at = end;
+    }
+    while (*at == ',' || *at == ' ' || *at == '\t') at++;
+    const char* name = at;
+    while (*at && *at != ',' && *at != ' ' && *at != '\t' && *at != '\r') at++;
+    report.frontendLines++;
+    Request request{Location(values[0], values[1]), Location(values[2], values[3]), 
+                    vehicleClassNamed(name, at - name), chrono::steady_clock::now()};
+    while (!queue.push(request)) {
+        if (!running.load(memory_order_acquire)) return;
+        this_thread::yield();
+    }
+    submitted.fetch_add(1, memory_order_relaxed);
+}
+
+RideService::RideService(RideSharingSimulator& simulator, size_t capacity, size_t batchSize, int tickMillis)
+    : simulator(simulator), queue(capacity), batchSize(max<size_t>(1, batchSize)),
+      tickInterval(chrono::milliseconds(max(1, tickMillis))), running(false), dispatching(false),
+      submitted(0), rejected(0) {}
+
+bool RideService::listen(const string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 && mkfifo(path.c_str(), 0600) != 0) return false;
+    frontendPath = path;
+    return true;
+}
+
+void RideService::start() {
+    if (running.exchange(true)) return;
+    dispatching.store(true);
+    dispatcher = thread(&RideService::dispatchLoop, this);
+    clock = thread(&RideService::clockLoop, this);
+    if (!frontendPath.empty()) frontend = thread(&RideService::frontendLoop, this);
+}
+
+void RideService::stop() {
+    if (!running.exchange(false)) return;
+    if (frontend.joinable()) {
+        // A reader still waiting in open() for a writer is released by one.
+        int fd = open(frontendPath.c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd >= 0) close(fd);
+        frontend.join();
+    }
+    clock.join();
+    dispatching.store(false);
+    dispatcher.join();
+}
+
+bool RideService::submit(const Location& pickup, const Location& destination, VehicleClass vehicle) {
+    if (!queue.push(Request{pickup, destination, vehicle, chrono::steady_clock::now()})) {
+        rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    submitted.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+const RideService::Report& RideService::getReport() {
+    report.submitted = submitted.load();
+    report.rejected = rejected.load();
+    return report;
+}
+
+MonteCarloSweep::Result MonteCarloSweep::runOne(const Point& point) const {
+    auto start = chrono::steady_clock::now();
+    RideSharingSimulator simulator(point.riders, point.drivers, EventJournal::QUIET, point.seed);
+    simulator.setSchedule(scheduleFor(point.scenario), ticksPerHour);
+    Result result;
+    result.point = point;
+    result.requested = simulator.runScheduledTicks(ticks);
+    const SimulationStats& stats = simulator.getStats();
+    result.completed = stats.getCompletedRides();
+    result.cancelled = stats.getCancelledRides();
+    result.earnings = stats.getTotalFares();
+    result.averageFare = stats.getAverageFare();
+    result.waitP50 = stats.getWaitTicks().quantile(0.50);
+    result.waitP90 = stats.getWaitTicks().quantile(0.90);
+    result.tripP50 = stats.getTripTicks().quantile(0.50);
+    result.millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool MonteCarloSweep::knownScenario(const string& scenario) {
+    RideSharingSimulator probe(0, 0, EventJournal::QUIET, 0);
+    return probe.setSchedule(scheduleFor(scenario), 60);
+}
+
+void MonteCarloSweep::addGrid(const vector<string>& scenarios, const vector<int>& drivers, const vector<int>& riders,
+                              const vector<uint64_t>& seeds) {
+    for (const string& scenario : scenarios)
+        for (int fleet : drivers)
+            for (int riderCount : riders)
+                for (uint64_t seed : seeds) points.push_back(Point{scenario, fleet, riderCount, seed});
+}
+
+void MonteCarloSweep::run(size_t jobs) {
+    results.assign(points.size(), Result());
+    WorkStealingPool pool(max<size_t>(1, jobs));
+    pool.parallelFor(points.size(), 1, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) results[i] = runOne(points[i]);
+    });
+}
+
+bool MonteCarloSweep::writeCsv(const string& path) const {
+    ExportBuffer out;
+    if (!out.open(path)) return false;
+    out.put("scenario,drivers,riders,seed,ticks,requested,completed,cancelled,completion_pct,earnings,"
+            "earnings_per_driver,average_fare,wait_p50,wait_p90,trip_p50,wall_ms\n");
+    for (const Result& r : results) {
+        out.field(r.point.scenario).field(r.point.drivers).field(r.point.riders).field((int64_t)r.point.seed)
+           .field(ticks).field(r.requested).field(r.completed).field(r.cancelled).field(r.completionRate(), 2)
+           .field(r.earnings, 2).field(r.earningsPerDriver(), 2).field(r.averageFare, 2)
+           .field(r.waitP50, 2).field(r.waitP90, 2).field(r.tripP50, 2).field(r.millis, 1);
+        out.endRow();
+    }
+    return out.close();
+}
+
+void MonteCarloSweep::printSummary() const {
+    struct Cell {
+        const Point* point;
+        int runs;
+        double completion[2], perDriver[2], wait[2], fare;
+    };
+    vector<Cell> cells;
+    map<tuple<string, int, int>, size_t> cellOf;
+    for (const Result& r : results) {
+        auto key = make_tuple(r.point.scenario, r.point.drivers, r.point.riders);
+        auto found = cellOf.find(key);
+        if (found == cellOf.end()) {
+            found = cellOf.emplace(key, cells.size()).first;
+            cells.push_back(Cell{&r.point, 0, {0, 0}, {0, 0}, {0, 0}, 0});
+        }
+        Cell& cell = cells[found->second];
+        cell.runs++;
+        double values[3] = {r.completionRate(), r.earningsPerDriver(), r.waitP90};
+        double* sums[3] = {cell.completion, cell.perDriver, cell.wait};
+        for (int k = 0; k < 3; k++) {
+            sums[k][0] += values[k];
+            sums[k][1] += values[k] * values[k];
+        }
+        cell.fare += r.averageFare;
+    }
+    
+    auto meanSd = [](const double* sum, int runs) {
+        double mean = sum[0] / runs;
+        double sd = runs > 1 ? sqrt(max(0.0, (sum[1] - runs * mean * mean) / (runs - 1))) : 0.0;
+        ostringstream text;
+        text << fixed << setprecision(2) << mean << " +/- " << sd;
+        return text.str();
+    };
+    cout << left << setw(12) << "scenario" << right << setw(9) << "drivers" << setw(9) << "riders" 
+         << setw(6) << "runs" << setw(20) << "completed %" << setw(22) << "earnings/driver" 
+         << setw(18) << "wait p90" << setw(12) << "avg fare" << "\n";
+    for (const Cell& cell : cells) {
+        cout << left << setw(12) << cell.point->scenario << right << setw(9) << cell.point->drivers 
+             << setw(9) << cell.point->riders << setw(6) << cell.runs 
+             << setw(20) << meanSd(cell.completion, cell.runs) << setw(22) << meanSd(cell.perDriver, cell.runs)
+             << setw(18) << meanSd(cell.wait, cell.runs) << setw(12) << fixed << setprecision(2) 
+             << cell.fare / cell.runs << "\n";
+    }
+}
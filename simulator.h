@@ -0,0 +1,3962 @@
+#ifndef RIDE_SIMULATOR_H
+#define RIDE_SIMULATOR_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <unordered_map>
+#include <string_view>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sstream>
+#include <fstream>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <cstring>
+#include <climits>
+#include <numeric>
+#include <charconv>
+#include <poll.h>
+
+class Location {
+private:
+    double x, y;
+
+public:
+    Location(double x = 0, double y = 0) : x(x), y(y) {}
+    
+    double getX() const { return x; }
+    double getY() const { return y; }
+    
+    double squaredDistanceTo(const Location& other) const {
+        double dx = x - other.x;
+        double dy = y - other.y;
+        return dx * dx + dy * dy;
+    }
+    
+    double distanceTo(const Location& other) const {
+        return sqrt(squaredDistanceTo(other));
+    }
+    
+    std::string toString() const {
+        return "(" + std::to_string((int)x) + "," + std::to_string((int)y) + ")";
+    }
+};
+
+// Structured record of every state transition. Producers append to a buffer
+// owned by their thread; full buffers are handed to a background writer, so the
+// simulation never blocks on the terminal. Narrated text (the human-readable
+// lines the menu shows) is only built when the verbosity asks for it.
+class EventJournal {
+public:
+    enum Verbosity { QUIET, RECORDS, NARRATED };
+    enum EventType { DRIVER_ONLINE, DRIVER_OFFLINE, TRIP_STARTED, TRIP_ENDED, RIDER_PAID, WALLET_TOPUP,
+                     RIDE_REQUESTED, RIDE_ASSIGNED, PICKUP_REACHED, RIDE_STARTED, RIDE_COMPLETED, RIDE_CANCELLED };
+    
+    struct Record {
+        long tick;
+        EventType type;
+        int rideId;
+        int driverId;
+        int riderId;
+        double amount;
+    };
+    
+    // One narrated line; the text is queued (with a trailing newline) when it goes out of scope.
+    class Line {
+    private:
+        EventJournal* journal;
+        std::ostringstream out;
+    
+    public:
+        explicit Line(EventJournal* journal) : journal(journal) {}
+        Line(const Line&) = delete;
+        Line& operator=(const Line&) = delete;
+        
+        template <typename T>
+        Line& operator<<(const T& value) { 
+            if (journal) out << value; 
+            return *this; 
+        }
+        
+        ~Line() {
+            if (journal) journal->appendText(out.str() + "\n");
+        }
+    };
+
+private:
+    struct Buffer {
+        std::mutex lock;
+        std::vector<Record> records;
+        std::string text;
+    };
+    
+    struct Batch {
+        std::vector<Record> records;
+        std::string text;
+    };
+    
+    static constexpr size_t BATCH_RECORDS = 4096;
+    static constexpr size_t BATCH_TEXT_BYTES = 1 << 16;
+    
+    Verbosity verbosity;
+    std::ostream* textSink;
+    std::ostream* recordSink;
+    std::unique_ptr<std::ofstream> recordFile;
+    std::atomic<long> tick;
+    const unsigned long serial;
+    
+    std::mutex buffersLock;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::condition_variable queueDrained;
+    std::deque<Batch> queue;
+    bool writerBusy;
+    bool stopping;
+    std::thread writer;
+    
+    static unsigned long nextSerial() {
+        static std::atomic<unsigned long> counter(0);
+        return ++counter;
+    }
+    
+    Buffer& localBuffer() {
+        thread_local unsigned long cachedSerial = 0;
+        thread_local Buffer* cached = nullptr;
+        thread_local std::map<unsigned long, Buffer*> owned;
+        if (cachedSerial == serial) return *cached;
+        
+        Buffer*& buffer = owned[serial];
+        if (!buffer) {
+            std::lock_guard<std::mutex> guard(buffersLock);
+            buffers.push_back(std::make_unique<Buffer>());
+            buffer = buffers.back().get();
+        }
+        cachedSerial = serial;
+        cached = buffer;
+        return *buffer;
+    }
+    
+    // Caller holds buffer.lock.
+    void handOff(Buffer& buffer) {
+        if (buffer.records.empty() && buffer.text.empty()) return;
+        Batch batch;
+        batch.records.swap(buffer.records);
+        batch.text.swap(buffer.text);
+        buffer.records.reserve(BATCH_RECORDS);
+        
+        std::lock_guard<std::mutex> guard(queueLock);
+        if (!writer.joinable()) {
+            writer = std::thread(&EventJournal::writerLoop, this);
+        }
+        queue.push_back(std::move(batch));
+        queueReady.notify_one();
+    }
+    
+    void appendText(const std::string& line) {
+        Buffer& buffer = localBuffer();
+        std::lock_guard<std::mutex> guard(buffer.lock);
+        buffer.text += line;
+        if (buffer.text.size() >= BATCH_TEXT_BYTES) handOff(buffer);
+    }
+    
+    void writerLoop() {
+        std::unique_lock<std::mutex> guard(queueLock);
+        while (true) {
+            queueReady.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            
+            Batch batch = std::move(queue.front());
+            queue.pop_front();
+            writerBusy = true;
+            guard.unlock();
+            write(batch);
+            guard.lock();
+            writerBusy = false;
+            if (queue.empty()) queueDrained.notify_all();
+        }
+    }
+    
+    void write(const Batch& batch) {
+        if (textSink && !batch.text.empty()) {
+            textSink->write(batch.text.data(), batch.text.size());
+            textSink->flush();
+        }
+        if (recordSink && !batch.records.empty()) {
+            std::string out;
+            out.reserve(batch.records.size() * 48);
+            char line[128];
+            for (const Record& r : batch.records) {
+                int n = snprintf(line, sizeof(line), "%ld,%s,%d,%d,%d,%.2f\n",
+                                 r.tick, eventName(r.type), r.rideId, r.driverId, r.riderId, r.amount);
+                out.append(line, n);
+            }
+            recordSink->write(out.data(), out.size());
+            recordSink->flush();
+        }
+    }
+
+public:
+    EventJournal(Verbosity verbosity = NARRATED, std::ostream* textSink = &std::cout)
+        : verbosity(verbosity), textSink(textSink), recordSink(nullptr), tick(0), serial(nextSerial()),
+          writerBusy(false), stopping(false) {}
+    
+    EventJournal(const EventJournal&) = delete;
+    EventJournal& operator=(const EventJournal&) = delete;
+    
+    ~EventJournal() {
+        flush();
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            stopping = true;
+            queueReady.notify_one();
+        }
+        if (writer.joinable()) writer.join();
+    }
+    
+    static const char* eventName(EventType type) {
+        switch(type) {
+            case DRIVER_ONLINE: return "DRIVER_ONLINE";
+            case DRIVER_OFFLINE: return "DRIVER_OFFLINE";
+            case TRIP_STARTED: return "TRIP_STARTED";
+            case TRIP_ENDED: return "TRIP_ENDED";
+            case RIDER_PAID: return "RIDER_PAID";
+            case WALLET_TOPUP: return "WALLET_TOPUP";
+            case RIDE_REQUESTED: return "RIDE_REQUESTED";
+            case RIDE_ASSIGNED: return "RIDE_ASSIGNED";
+            case PICKUP_REACHED: return "PICKUP_REACHED";
+            case RIDE_STARTED: return "RIDE_STARTED";
+            case RIDE_COMPLETED: return "RIDE_COMPLETED";
+            case RIDE_CANCELLED: return "RIDE_CANCELLED";
+            default: return "UNKNOWN";
+        }
+    }
+    
+    Verbosity getVerbosity() const { return verbosity; }
+    void setVerbosity(Verbosity level) { verbosity = level; }
+    bool narrating() const { return verbosity == NARRATED; }
+    bool recording() const { return verbosity != QUIET && recordSink; }
+    
+    long getTick() const { return tick.load(std::memory_order_relaxed); }
+    void setTick(long value) { tick.store(value, std::memory_order_relaxed); }
+    
+    // Records are written as CSV lines: tick,event,ride,driver,rider,amount.
+    bool openRecordFile(const std::string& path) {
+        flush();
+        recordFile = std::make_unique<std::ofstream>(path, std::ios::out | std::ios::trunc);
+        if (!*recordFile) {
+            recordFile.reset();
+            recordSink = nullptr;
+            return false;
+        }
+        *recordFile << "tick,event,ride,driver,rider,amount\n";
+        recordSink = recordFile.get();
+        if (verbosity == QUIET) verbosity = RECORDS;
+        return true;
+    }
+    
+    void record(EventType type, int rideId, int driverId, int riderId, double amount = 0.0) {
+        if (!recording()) return;
+        Buffer& buffer = localBuffer();
+        std::lock_guard<std::mutex> guard(buffer.lock);
+        buffer.records.push_back(Record{getTick(), type, rideId, driverId, riderId, amount});
+        if (buffer.records.size() >= BATCH_RECORDS) handOff(buffer);
+    }
+    
+    Line narrate() { return Line(narrating() ? this : nullptr); }
+    
+    // Hands every thread's pending events to the writer and waits until they are written.
+    void flush() {
+        {
+            std::lock_guard<std::mutex> guard(buffersLock);
+            for (auto& buffer : buffers) {
+                std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+                handOff(*buffer);
+            }
+        }
+        std::unique_lock<std::mutex> guard(queueLock);
+        queueDrained.wait(guard, [this] { return queue.empty() && !writerBusy; });
+    }
+};
+
+// Counter-based generator: the n-th draw of a stream is a pure hash of
+// (seed, domain, index, n). Streams share no state, so every entity or worker
+// can own one and a run replays bit-identically from its seed.
+class RandomStream {
+private:
+    uint64_t key;
+    uint64_t counter;
+    
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    RandomStream(uint64_t seed = 0, uint64_t domain = 0, uint64_t index = 0)
+        : key(mix(mix(seed ^ mix(domain + 0x9E3779B97F4A7C15ULL)) + index)), counter(0) {}
+    
+    uint64_t getCounter() const { return counter; }
+    void setCounter(uint64_t value) { counter = value; }
+    
+    uint64_t next() { return mix(key + 0x9E3779B97F4A7C15ULL * ++counter); }
+    
+    // Uniform in [0, bound).
+    int nextInt(int bound) { return (int)(((next() >> 32) * (uint64_t)bound) >> 32); }
+    
+    // Uniform in [0, 1).
+    double nextDouble() { return (next() >> 11) * 0x1.0p-53; }
+    
+    // Same values as n calls to nextInt(bound). Each draw depends only on its own
+    // counter value, so the loop carries no state and vectorizes.
+    void fillInts(int bound, int* out, size_t n) {
+        uint64_t base = counter;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t z = mix(key + 0x9E3779B97F4A7C15ULL * (base + i + 1));
+            out[i] = (int)(((z >> 32) * (uint64_t)bound) >> 32);
+        }
+        counter += n;
+    }
+    
+    // Poisson-distributed count with the given mean: inversion for small means,
+    // Hormann's PTRS transformed rejection above that, so the cost stays flat
+    // however large the mean grows.
+    long nextPoisson(double mean) {
+        if (mean <= 0) return 0;
+        if (mean < 10) {
+            double limit = exp(-mean), product = nextDouble();
+            long k = 0;
+            while (product > limit) {
+                product *= nextDouble();
+                k++;
+            }
+            return k;
+        }
+        double root = sqrt(mean), logMean = log(mean);
+        double b = 0.931 + 2.53 * root;
+        double a = -0.059 + 0.02483 * b;
+        double inverseAlpha = 1.1239 + 1.1328 / (b - 3.4);
+        double vr = 0.9277 - 3.6224 / (b - 2);
+        while (true) {
+            double u = nextDouble() - 0.5;
+            double v = nextDouble();
+            double us = 0.5 - fabs(u);
+            long k = (long)floor((2 * a / us + b) * u + mean + 0.43);
+            if (us >= 0.07 && v <= vr) return k;
+            if (k < 0 || (us < 0.013 && v > us)) continue;
+            if (log(v) + log(inverseAlpha) - log(a / (us * us) + b) <= -mean + k * logMean - lgamma(k + 1.0)) return k;
+        }
+    }
+};
+
+// Raw little helpers for the snapshot format: values are copied byte for byte,
+// and reads fail instead of running past the end of the buffer.
+template <typename T>
+void appendBytes(std::vector<char>& out, const T& value) {
+    const char* bytes = (const char*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool readBytes(const char*& data, const char* end, T& value) {
+    if ((size_t)(end - data) < sizeof(T)) return false;
+    memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return true;
+}
+
+// Log-bucketed quantile sketch (DDSketch-style). Bucket k holds values in
+// (gamma^(k-1), gamma^k], so any quantile comes back within relativeAccuracy
+// of a true sample, memory grows with the value range rather than the count,
+// and two sketches with the same accuracy merge by adding buckets.
+class QuantileSketch {
+private:
+    double gamma;
+    double logGamma;
+    std::vector<uint64_t> buckets;
+    int offset;
+    uint64_t zeroCount;
+    uint64_t count;
+    double sum;
+    double minValue;
+    double maxValue;
+    
+    static constexpr double MIN_POSITIVE = 1e-9;
+    
+    int bucketOf(double value) const { return (int)ceil(log(value) / logGamma); }
+    
+    void addToBucket(int k, uint64_t n) {
+        if (buckets.empty()) {
+            offset = k;
+            buckets.assign(1, 0);
+        } else if (k < offset) {
+            buckets.insert(buckets.begin(), offset - k, 0);
+            offset = k;
+        } else if (k >= offset + (int)buckets.size()) {
+            buckets.resize(k - offset + 1, 0);
+        }
+        buckets[k - offset] += n;
+    }
+
+public:
+    explicit QuantileSketch(double relativeAccuracy = 0.01)
+        : gamma((1 + relativeAccuracy) / (1 - relativeAccuracy)), logGamma(log(gamma)), offset(0), 
+          zeroCount(0), count(0), sum(0), minValue(0), maxValue(0) {}
+    
+    uint64_t getCount() const { return count; }
+    double getSum() const { return sum; }
+    double getMean() const { return count ? sum / count : 0.0; }
+    double getMin() const { return minValue; }
+    double getMax() const { return maxValue; }
+    
+    void add(double value) {
+        minValue = count ? std::min(minValue, value) : value;
+        maxValue = count ? std::max(maxValue, value) : value;
+        count++;
+        sum += value;
+        if (value <= MIN_POSITIVE) {
+            zeroCount++;
+        } else {
+            addToBucket(bucketOf(value), 1);
+        }
+    }
+    
+    void merge(const QuantileSketch& other) {
+        if (other.count == 0) return;
+        minValue = count ? std::min(minValue, other.minValue) : other.minValue;
+        maxValue = count ? std::max(maxValue, other.maxValue) : other.maxValue;
+        count += other.count;
+        sum += other.sum;
+        zeroCount += other.zeroCount;
+        for (size_t i = 0; i < other.buckets.size(); i++) {
+            if (other.buckets[i]) addToBucket(other.offset + i, other.buckets[i]);
+        }
+    }
+    
+    void appendTo(std::vector<char>& out) const {
+        appendBytes(out, gamma);
+        appendBytes(out, (int64_t)offset);
+        appendBytes(out, zeroCount);
+        appendBytes(out, count);
+        appendBytes(out, sum);
+        appendBytes(out, minValue);
+        appendBytes(out, maxValue);
+        appendBytes(out, (uint64_t)buckets.size());
+        for (uint64_t bucket : buckets) appendBytes(out, bucket);
+    }
+    
+    bool readFrom(const char*& data, const char* end) {
+        double savedGamma;
+        int64_t savedOffset;
+        uint64_t bucketCount;
+        if (!readBytes(data, end, savedGamma) || savedGamma != gamma) return false;
+        if (!readBytes(data, end, savedOffset) || !readBytes(data, end, zeroCount) || !readBytes(data, end, count) ||
+            !readBytes(data, end, sum) || !readBytes(data, end, minValue) || !readBytes(data, end, maxValue) ||
+            !readBytes(data, end, bucketCount)) return false;
+        if (bucketCount > (uint64_t)(end - data) / sizeof(uint64_t)) return false;
+        offset = savedOffset;
+        buckets.resize(bucketCount);
+        for (uint64_t& bucket : buckets) readBytes(data, end, bucket);
+        return true;
+    }
+    
+    double quantile(double q) const {
+        if (count == 0) return 0.0;
+        uint64_t rank = (uint64_t)(std::min(std::max(q, 0.0), 1.0) * (count - 1));
+        if (rank < zeroCount) return minValue;
+        uint64_t seen = zeroCount;
+        for (size_t i = 0; i < buckets.size(); i++) {
+            seen += buckets[i];
+            if (seen > rank) {
+                double estimate = 2 * pow(gamma, (int)i + offset) / (gamma + 1);
+                return std::min(std::max(estimate, minValue), maxValue);
+            }
+        }
+        return maxValue;
+    }
+};
+
+// Aggregates kept current at every settlement, so statistics never rescan the
+// fleet or the ride history. Times are in simulation ticks.
+class SimulationStats {
+private:
+    long completedRides;
+    long cancelledRides;
+    double totalFares;
+    QuantileSketch waitTicks;
+    QuantileSketch tripTicks;
+    QuantileSketch fares;
+
+public:
+    SimulationStats() : completedRides(0), cancelledRides(0), totalFares(0.0) {}
+    
+    long getCompletedRides() const { return completedRides; }
+    long getCancelledRides() const { return cancelledRides; }
+    double getTotalFares() const { return totalFares; }
+    double getAverageFare() const { return completedRides ? totalFares / completedRides : 0.0; }
+    const QuantileSketch& getWaitTicks() const { return waitTicks; }
+    const QuantileSketch& getTripTicks() const { return tripTicks; }
+    const QuantileSketch& getFares() const { return fares; }
+    
+    void recordCompletion(double fare, long waited, long travelled) {
+        completedRides++;
+        totalFares += fare;
+        fares.add(fare);
+        waitTicks.add(waited);
+        tripTicks.add(travelled);
+    }
+    
+    void recordCancellation() { cancelledRides++; }
+    
+    void appendTo(std::vector<char>& out) const {
+        appendBytes(out, (int64_t)completedRides);
+        appendBytes(out, (int64_t)cancelledRides);
+        appendBytes(out, totalFares);
+        waitTicks.appendTo(out);
+        tripTicks.appendTo(out);
+        fares.appendTo(out);
+    }
+    
+    bool readFrom(const char*& data, const char* end) {
+        int64_t completed, cancelled;
+        if (!readBytes(data, end, completed) || !readBytes(data, end, cancelled) || 
+            !readBytes(data, end, totalFares)) return false;
+        completedRides = completed;
+        cancelledRides = cancelled;
+        return waitTicks.readFrom(data, end) && tripTicks.readFrom(data, end) && fares.readFrom(data, end);
+    }
+    
+    void merge(const SimulationStats& other) {
+        completedRides += other.completedRides;
+        cancelledRides += other.cancelledRides;
+        totalFares += other.totalFares;
+        waitTicks.merge(other.waitTicks);
+        tripTicks.merge(other.tripTicks);
+        fares.merge(other.fares);
+    }
+};
+
+// Per-phase wall-clock timers for the hot path. Each phase keeps a call count
+// and total time, plus a sketch of how long it took per tick, so a slow phase
+// shows up as a shifted tail rather than a slightly larger average. Building
+// with RIDE_NO_METRICS turns every method into an empty inline and the timers
+// into empty objects, so the instrumentation costs nothing when compiled out.
+class PhaseMetrics {
+public:
+    enum Phase { REQUEST, MATCHING, RIDE_UPDATE, SETTLEMENT, ZONES, PHASE_COUNT };
+    
+    static const char* phaseName(int phase) {
+        static const char* names[] = {"request", "matching", "ride_update", "settlement", "zones"};
+        return names[phase];
+    }
+    
+    // Gauges the owner reports alongside the timers at export time.
+    struct Gauge {
+        const char* name;
+        double value;
+    };
+
+#ifndef RIDE_NO_METRICS
+private:
+    uint64_t calls[PHASE_COUNT];
+    uint64_t nanos[PHASE_COUNT];
+    uint64_t tickNanos[PHASE_COUNT];
+    QuantileSketch perTick[PHASE_COUNT];
+    QuantileSketch tickTotal;
+    uint64_t ticks;
+
+public:
+    PhaseMetrics() : ticks(0) {
+        for (int p = 0; p < PHASE_COUNT; p++) calls[p] = nanos[p] = tickNanos[p] = 0;
+    }
+    
+    void add(Phase phase, uint64_t elapsed) {
+        calls[phase]++;
+        nanos[phase] += elapsed;
+        tickNanos[phase] += elapsed;
+    }
+    
+    // Folds the time spent since the previous call into the per-tick sketches.
+    // Sketches only hold positive values, so idle phases are not sampled.
+    void endTick() {
+        uint64_t total = 0;
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            if (tickNanos[p] > 0) perTick[p].add((double)tickNanos[p]);
+            total += tickNanos[p];
+            tickNanos[p] = 0;
+        }
+        if (total > 0) tickTotal.add((double)total);
+        ticks++;
+    }
+    
+    // Counts ticks the event engine skipped because nothing happened in them.
+    void skipTicks(uint64_t count) { ticks += count; }
+    
+    uint64_t getCalls(Phase phase) const { return calls[phase]; }
+    double getSeconds(Phase phase) const { return nanos[phase] * 1e-9; }
+    const QuantileSketch& getPerTick(Phase phase) const { return perTick[phase]; }
+    
+    void writePrometheus(std::ostream& out, const std::vector<Gauge>& gauges) const {
+        static const double quantiles[] = {0.5, 0.9, 0.99};
+        out << "# TYPE ride_sim_phase_calls_total counter\n";
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            out << "ride_sim_phase_calls_total{phase=\"" << phaseName(p) << "\"} " << calls[p] << "\n";
+        }
+        out << "# TYPE ride_sim_phase_seconds_total counter\n";
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            out << "ride_sim_phase_seconds_total{phase=\"" << phaseName(p) << "\"} " << nanos[p] * 1e-9 << "\n";
+        }
+        out << "# TYPE ride_sim_phase_tick_seconds summary\n";
+        for (int p = 0; p <= PHASE_COUNT; p++) {
+            const QuantileSketch& sketch = p < PHASE_COUNT ? perTick[p] : tickTotal;
+            const char* name = p < PHASE_COUNT ? phaseName(p) : "total";
+            for (double q : quantiles) {
+                out << "ride_sim_phase_tick_seconds{phase=\"" << name << "\",quantile=\"" << q << "\"} " 
+                    << sketch.quantile(q) * 1e-9 << "\n";
+            }
+            out << "ride_sim_phase_tick_seconds_sum{phase=\"" << name << "\"} " << sketch.getSum() * 1e-9 << "\n";
+            out << "ride_sim_phase_tick_seconds_count{phase=\"" << name << "\"} " << sketch.getCount() << "\n";
+        }
+        out << "# TYPE ride_sim_ticks_total counter\nride_sim_ticks_total " << ticks << "\n";
+        for (const Gauge& gauge : gauges) {
+            out << "# TYPE ride_sim_" << gauge.name << " gauge\nride_sim_" << gauge.name << " " << gauge.value << "\n";
+        }
+    }
+    
+    void writeJson(std::ostream& out, const std::vector<Gauge>& gauges) const {
+        out << "{\"ticks\":" << ticks << ",\"phases\":{";
+        for (int p = 0; p <= PHASE_COUNT; p++) {
+            const QuantileSketch& sketch = p < PHASE_COUNT ? perTick[p] : tickTotal;
+            if (p > 0) out << ",";
+            out << "\"" << (p < PHASE_COUNT ? phaseName(p) : "total") << "\":{";
+            if (p < PHASE_COUNT) out << "\"calls\":" << calls[p] << ",\"seconds\":" << nanos[p] * 1e-9 << ",";
+            out << "\"tick_seconds\":{\"count\":" << sketch.getCount() << ",\"p50\":" << sketch.quantile(0.5) * 1e-9
+                << ",\"p90\":" << sketch.quantile(0.9) * 1e-9 << ",\"p99\":" << sketch.quantile(0.99) * 1e-9
+                << ",\"max\":" << sketch.getMax() * 1e-9 << "}}";
+        }
+        out << "}";
+        for (const Gauge& gauge : gauges) out << ",\"" << gauge.name << "\":" << gauge.value;
+        out << "}\n";
+    }
+#else
+public:
+    void add(Phase, uint64_t) {}
+    void endTick() {}
+    void skipTicks(uint64_t) {}
+    
+    void writePrometheus(std::ostream& out, const std::vector<Gauge>& gauges) const {
+        for (const Gauge& gauge : gauges) {
+            out << "# TYPE ride_sim_" << gauge.name << " gauge\nride_sim_" << gauge.name << " " << gauge.value << "\n";
+        }
+    }
+    
+    void writeJson(std::ostream& out, const std::vector<Gauge>& gauges) const {
+        out << "{";
+        for (size_t i = 0; i < gauges.size(); i++) {
+            out << (i ? "," : "") << "\"" << gauges[i].name << "\":" << gauges[i].value;
+        }
+        out << "}\n";
+    }
+#endif
+};
+
+// Charges the lifetime of the enclosing scope to one phase.
+class ScopedPhase {
+#ifndef RIDE_NO_METRICS
+private:
+    PhaseMetrics& metrics;
+    PhaseMetrics::Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    ScopedPhase(PhaseMetrics& metrics, PhaseMetrics::Phase phase) 
+        : metrics(metrics), phase(phase), start(std::chrono::steady_clock::now()) {}
+    
+    ~ScopedPhase() {
+        metrics.add(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+#else
+public:
+    ScopedPhase(PhaseMetrics&, PhaseMetrics::Phase) {}
+#endif
+    
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+};
+
+// Optional street graph. Text format, one record per line ('#' starts a comment):
+//   n X Y           a junction; junctions are numbered from 0 in file order
+//   e A B [LENGTH]  a two-way road between junctions A and B (LENGTH defaults
+//                   to the straight-line distance between them)
+// Point-to-point queries run A* bounded below by ALT landmarks: the graph
+// distances from a few far-apart junctions give |d(L,t) - d(L,v)| <= d(v,t).
+// Those tables are the only preprocessing, and a cache file holding them is
+// reused only while it matches the graph it was built from. Locations off the
+// graph join it in a straight line at their nearest junction.
+class RoadNetwork {
+public:
+    static const int DEFAULT_LANDMARKS = 8;
+
+private:
+    struct CacheHeader {
+        char magic[8];
+        uint64_t nodes;
+        uint64_t edges;
+        uint64_t graphHash;
+        uint64_t landmarks;
+    };
+    
+    static constexpr char CACHE_MAGIC[8] = {'R', 'I', 'D', 'E', 'A', 'L', 'T', '1'};
+    
+    std::vector<double> nodeX, nodeY;
+    std::vector<uint32_t> firstEdge;
+    std::vector<uint32_t> edgeTarget;
+    std::vector<double> edgeLength;
+    
+    int landmarkCount;
+    std::vector<double> landmarkDistance;
+    
+    double originX, originY, cellSize;
+    int cols, rows;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellNodes;
+    
+    // Per-thread search state. Entries count as unset unless stamped with the
+    // current generation, so a query never has to clear arrays the size of the graph.
+    struct Scratch {
+        std::vector<double> distance;
+        std::vector<uint32_t> parent;
+        std::vector<uint32_t> reached;
+        std::vector<uint32_t> settled;
+        std::vector<std::pair<double, uint32_t>> heap;
+        uint32_t generation = 0;
+        
+        uint32_t begin(size_t nodes) {
+            if (reached.size() < nodes) {
+                distance.resize(nodes);
+                parent.resize(nodes);
+                reached.resize(nodes, 0);
+                settled.resize(nodes, 0);
+            }
+            heap.clear();
+            if (++generation == 0) {
+                std::fill(reached.begin(), reached.end(), 0);
+                std::fill(settled.begin(), settled.end(), 0);
+                generation = 1;
+            }
+            return generation;
+        }
+        
+        void push(double key, uint32_t node) {
+            heap.push_back(std::make_pair(key, node));
+            std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<double, uint32_t>>());
+        }
+        
+        std::pair<double, uint32_t> pop() {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<double, uint32_t>>());
+            std::pair<double, uint32_t> top = heap.back();
+            heap.pop_back();
+            return top;
+        }
+    };
+    
+    static Scratch& scratch() {
+        thread_local Scratch work;
+        return work;
+    }
+    
+    size_t nodes() const { return nodeX.size(); }
+    Location nodeAt(uint32_t v) const { return Location(nodeX[v], nodeY[v]); }
+    
+    uint64_t graphHash() const {
+        uint64_t hash = 1469598103934665603ULL;
+        auto mixIn = [&hash](const void* data, size_t bytes) {
+            const unsigned char* p = (const unsigned char*)data;
+            for (size_t i = 0; i < bytes; i++) hash = (hash ^ p[i]) * 1099511628211ULL;
+        };
+        mixIn(nodeX.data(), nodeX.size() * sizeof(double));
+        mixIn(nodeY.data(), nodeY.size() * sizeof(double));
+        mixIn(firstEdge.data(), firstEdge.size() * sizeof(uint32_t));
+        mixIn(edgeTarget.data(), edgeTarget.size() * sizeof(uint32_t));
+        mixIn(edgeLength.data(), edgeLength.size() * sizeof(double));
+        return hash;
+    }
+    
+    // Plain Dijkstra over the whole graph; unreachable junctions stay infinite.
+    void shortestFrom(uint32_t source, double* out) const {
+        std::fill(out, out + nodes(), HUGE_VAL);
+        Scratch& work = scratch();
+        work.begin(nodes());
+        out[source] = 0;
+        work.push(0, source);
+        while (!work.heap.empty()) {
+            std::pair<double, uint32_t> top = work.pop();
+            uint32_t v = top.second;
+            if (top.first > out[v]) continue;
+            for (uint32_t e = firstEdge[v]; e < firstEdge[v + 1]; e++) {
+                double candidate = top.first + edgeLength[e];
+                if (candidate < out[edgeTarget[e]]) {
+                    out[edgeTarget[e]] = candidate;
+                    work.push(candidate, edgeTarget[e]);
+                }
+            }
+        }
+    }
+    
+    // Farthest-point selection: each landmark is the junction farthest from the
+    // ones already chosen, which spreads them round the edge of the network.
+    void buildLandmarks(int wanted) {
+        landmarkCount = nodes() ? std::min<int>(wanted, nodes()) : 0;
+        landmarkDistance.assign((size_t)landmarkCount * nodes(), HUGE_VAL);
+        std::vector<double> nearestLandmark(nodes(), HUGE_VAL);
+        std::vector<double> probe(nodes());
+        shortestFrom(0, probe.data());
+        uint32_t next = 0;
+        for (uint32_t v = 0; v < nodes(); v++) {
+            if (!std::isinf(probe[v]) && probe[v] > probe[next]) next = v;
+        }
+        for (int l = 0; l < landmarkCount; l++) {
+            double* row = &landmarkDistance[(size_t)l * nodes()];
+            shortestFrom(next, row);
+            for (uint32_t v = 0; v < nodes(); v++) {
+                nearestLandmark[v] = std::min(nearestLandmark[v], row[v]);
+                if (nearestLandmark[v] > nearestLandmark[next]) next = v;
+            }
+        }
+    }
+    
+    double lowerBound(uint32_t v, uint32_t target) const {
+        double best = 0;
+        for (int l = 0; l < landmarkCount; l++) {
+            const double* row = &landmarkDistance[(size_t)l * nodes()];
+            if (std::isinf(row[v]) || std::isinf(row[target])) continue;
+            best = std::max(best, fabs(row[target] - row[v]));
+        }
+        return best;
+    }
+    
+    // A* from source to target. On success the path can be read back through
+    // the scratch parents until the calling thread's next query.
+    double search(uint32_t source, uint32_t target) const {
+        Scratch& work = scratch();
+        uint32_t generation = work.begin(nodes());
+        work.distance[source] = 0;
+        work.parent[source] = source;
+        work.reached[source] = generation;
+        work.push(lowerBound(source, target), source);
+        while (!work.heap.empty()) {
+            uint32_t v = work.pop().second;
+            if (work.settled[v] == generation) continue;
+            work.settled[v] = generation;
+            if (v == target) return work.distance[v];
+            for (uint32_t e = firstEdge[v]; e < firstEdge[v + 1]; e++) {
+                uint32_t u = edgeTarget[e];
+                double candidate = work.distance[v] + edgeLength[e];
+                if (work.reached[u] != generation || candidate < work.distance[u]) {
+                    work.reached[u] = generation;
+                    work.distance[u] = candidate;
+                    work.parent[u] = v;
+                    work.push(candidate + lowerBound(u, target), u);
+                }
+            }
+        }
+        return HUGE_VAL;
+    }
+    
+    void buildSnapGrid() {
+        double maxX = originX = nodes() ? nodeX[0] : 0;
+        double maxY = originY = nodes() ? nodeY[0] : 0;
+        for (uint32_t v = 0; v < nodes(); v++) {
+            originX = std::min(originX, nodeX[v]);
+            originY = std::min(originY, nodeY[v]);
+            maxX = std::max(maxX, nodeX[v]);
+            maxY = std::max(maxY, nodeY[v]);
+        }
+        double area = std::max((maxX - originX) * (maxY - originY), 1e-9);
+        cellSize = std::max(sqrt(2.0 * area / std::max<size_t>(nodes(), 1)), 1e-6);
+        cols = std::min(4096, (int)((maxX - originX) / cellSize) + 1);
+        rows = std::min(4096, (int)((maxY - originY) / cellSize) + 1);
+        cellSize = std::max((maxX - originX) / cols, (maxY - originY) / rows) * (1 + 1e-9) + 1e-9;
+        
+        cellStart.assign((size_t)cols * rows + 1, 0);
+        for (uint32_t v = 0; v < nodes(); v++) cellStart[cellOf(nodeX[v], nodeY[v]) + 1]++;
+        for (size_t c = 1; c < cellStart.size(); c++) cellStart[c] += cellStart[c - 1];
+        cellNodes.resize(nodes());
+        std::vector<uint32_t> fillAt(cellStart.begin(), cellStart.end() - 1);
+        for (uint32_t v = 0; v < nodes(); v++) cellNodes[fillAt[cellOf(nodeX[v], nodeY[v])]++] = v;
+    }
+    
+    int cellColumn(double x) const { return std::min(std::max((int)floor((x - originX) / cellSize), 0), cols - 1); }
+    int cellRow(double y) const { return std::min(std::max((int)floor((y - originY) / cellSize), 0), rows - 1); }
+    size_t cellOf(double x, double y) const { return (size_t)cellRow(y) * cols + cellColumn(x); }
+    
+    // Rings of cells outward from the location's cell; a ring r cells out is at
+    // least (r - 1) * cellSize away, which bounds when the search can stop.
+    uint32_t nearestNode(const Location& at) const {
+        int cx = cellColumn(at.getX()), cy = cellRow(at.getY());
+        uint32_t best = 0;
+        double bestSquared = HUGE_VAL;
+        for (int ring = 0; ring <= std::max(cols, rows); ring++) {
+            double reach = (ring - 1) * cellSize;
+            if (ring > 0 && !std::isinf(bestSquared) && reach > 0 && reach * reach >= bestSquared) break;
+            for (int y = cy - ring; y <= cy + ring; y++) {
+                if (y < 0 || y >= rows) continue;
+                bool edgeRow = y == cy - ring || y == cy + ring;
+                for (int x = cx - ring; x <= cx + ring; x += edgeRow ? 1 : 2 * std::max(ring, 1)) {
+                    if (x < 0 || x >= cols) continue;
+                    size_t cell = (size_t)y * cols + x;
+                    for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+                        double squared = at.squaredDistanceTo(nodeAt(cellNodes[i]));
+                        if (squared < bestSquared) {
+                            bestSquared = squared;
+                            best = cellNodes[i];
+                        }
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+public:
+    RoadNetwork() : landmarkCount(0), originX(0), originY(0), cellSize(1), cols(1), rows(1) {}
+    
+    size_t getJunctionCount() const { return nodes(); }
+    size_t getRoadCount() const { return edgeTarget.size() / 2; }
+    int getLandmarkCount() const { return landmarkCount; }
+    
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) return false;
+        std::vector<double> xs, ys;
+        std::vector<std::pair<uint32_t, uint32_t>> roads;
+        std::vector<double> lengths;
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string kind;
+            if (!(fields >> kind) || kind[0] == '#') continue;
+            if (kind == "n") {
+                double x, y;
+                if (!(fields >> x >> y)) return false;
+                xs.push_back(x);
+                ys.push_back(y);
+            } else if (kind == "e") {
+                long a, b;
+                if (!(fields >> a >> b) || a < 0 || b < 0 || a >= (long)xs.size() || b >= (long)xs.size()) return false;
+                double length;
+                if (!(fields >> length)) length = Location(xs[a], ys[a]).distanceTo(Location(xs[b], ys[b]));
+                if (length < 0) return false;
+                roads.push_back(std::make_pair((uint32_t)a, (uint32_t)b));
+                lengths.push_back(length);
+            } else {
+                return false;
+            }
+        }
+        
+        nodeX.swap(xs);
+        nodeY.swap(ys);
+        firstEdge.assign(nodes() + 1, 0);
+        for (const auto& road : roads) {
+            firstEdge[road.first + 1]++;
+            firstEdge[road.second + 1]++;
+        }
+        for (size_t v = 1; v < firstEdge.size(); v++) firstEdge[v] += firstEdge[v - 1];
+        edgeTarget.resize(2 * roads.size());
+        edgeLength.resize(2 * roads.size());
+        std::vector<uint32_t> fillAt(firstEdge.begin(), firstEdge.end() - 1);
+        for (size_t i = 0; i < roads.size(); i++) {
+            uint32_t a = roads[i].first, b = roads[i].second;
+            edgeTarget[fillAt[a]] = b;
+            edgeLength[fillAt[a]++] = lengths[i];
+            edgeTarget[fillAt[b]] = a;
+            edgeLength[fillAt[b]++] = lengths[i];
+        }
+        landmarkCount = 0;
+        landmarkDistance.clear();
+        buildSnapGrid();
+        return nodes() > 0;
+    }
+    
+    // Reuses cachePath if it was built from this exact graph, otherwise builds
+    // the landmark tables and (if cachePath is set) writes them there.
+    bool prepare(const std::string& cachePath, int landmarks = DEFAULT_LANDMARKS) {
+        if (!cachePath.empty() && loadCache(cachePath)) return true;
+        buildLandmarks(landmarks);
+        return cachePath.empty() || saveCache(cachePath);
+    }
+    
+    bool loadCache(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        CacheHeader header;
+        if (!in.read((char*)&header, sizeof(header))) return false;
+        if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.nodes != nodes() || 
+            header.edges != edgeTarget.size() || header.graphHash != graphHash() || header.landmarks > nodes()) return false;
+        std::vector<double> table(header.landmarks * nodes());
+        if (!in.read((char*)table.data(), table.size() * sizeof(double))) return false;
+        landmarkCount = header.landmarks;
+        landmarkDistance.swap(table);
+        return true;
+    }
+    
+    bool saveCache(const std::string& path) const {
+        CacheHeader header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.nodes = nodes();
+        header.edges = edgeTarget.size();
+        header.graphHash = graphHash();
+        header.landmarks = landmarkCount;
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)landmarkDistance.data(), landmarkDistance.size() * sizeof(double));
+        return (bool)out;
+    }
+    
+    // Road distance between two map points; straight-line when they share a
+    // nearest junction or the graph does not connect them.
+    double distance(const Location& from, const Location& to) const {
+        uint32_t a = nearestNode(from), b = nearestNode(to);
+        return joined(from, a, a == b ? 0 : search(a, b), b, to);
+    }
+    
+    // Waypoints from `from` to `to`: the junctions along the shortest path,
+    // then `to` itself.
+    std::vector<Location> route(const Location& from, const Location& to) const {
+        std::vector<Location> waypoints;
+        uint32_t a = nearestNode(from), b = nearestNode(to);
+        if (a != b && !std::isinf(search(a, b))) {
+            const Scratch& work = scratch();
+            for (uint32_t v = b; ; v = work.parent[v]) {
+                waypoints.push_back(nodeAt(v));
+                if (v == a) break;
+            }
+            std::reverse(waypoints.begin(), waypoints.end());
+        }
+        waypoints.push_back(to);
+        return waypoints;
+    }
+    
+    // Road distance from one point to many, in a single Dijkstra; this is what
+    // matching asks per request.
+    void distancesFrom(const Location& from, const std::vector<Location>& targets, std::vector<double>& out) const {
+        uint32_t source = nearestNode(from);
+        std::vector<uint32_t> targetNodes(targets.size());
+        for (size_t i = 0; i < targets.size(); i++) targetNodes[i] = nearestNode(targets[i]);
+        junctionDistancesFrom(source, targetNodes, out);
+        for (size_t i = 0; i < targets.size(); i++) {
+            out[i] = joined(from, source, out[i], targetNodes[i], targets[i]);
+        }
+    }
+    
+    uint32_t junctionNear(const Location& at) const { return nearestNode(at); }
+    Location junctionAt(uint32_t v) const { return nodeAt(v); }
+    double junctionDistance(uint32_t a, uint32_t b) const { return a == b ? 0 : search(a, b); }
+    
+    // Adds the straight legs from `from` to junction a and from b to `to` onto the
+    // a-b graph distance, falling back to the straight line as distance() does.
+    double joined(const Location& from, uint32_t a, double graph, uint32_t b, const Location& to) const {
+        if (a == b || std::isinf(graph)) return from.distanceTo(to);
+        return from.distanceTo(nodeAt(a)) + graph + nodeAt(b).distanceTo(to);
+    }
+    
+    // Graph distances from one junction to many, in a single Dijkstra that stops
+    // once every target is settled. Unreachable targets come back infinite.
+    void junctionDistancesFrom(uint32_t source, const std::vector<uint32_t>& targetNodes, std::vector<double>& out) const {
+        out.assign(targetNodes.size(), HUGE_VAL);
+        if (targetNodes.empty()) return;
+        std::vector<uint32_t> wanted(targetNodes);
+        std::sort(wanted.begin(), wanted.end());
+        wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+        size_t pending = wanted.size();
+        
+        Scratch& work = scratch();
+        uint32_t generation = work.begin(nodes());
+        work.distance[source] = 0;
+        work.reached[source] = generation;
+        work.push(0, source);
+        while (!work.heap.empty() && pending > 0) {
+            uint32_t v = work.pop().second;
+            if (work.settled[v] == generation) continue;
+            work.settled[v] = generation;
+            if (std::binary_search(wanted.begin(), wanted.end(), v)) pending--;
+            for (uint32_t e = firstEdge[v]; e < firstEdge[v + 1]; e++) {
+                uint32_t u = edgeTarget[e];
+                double candidate = work.distance[v] + edgeLength[e];
+                if (work.reached[u] != generation || candidate < work.distance[u]) {
+                    work.reached[u] = generation;
+                    work.distance[u] = candidate;
+                    work.push(candidate, u);
+                }
+            }
+        }
+        for (size_t i = 0; i < targetNodes.size(); i++) {
+            if (work.settled[targetNodes[i]] == generation) out[i] = work.distance[targetNodes[i]];
+        }
+    }
+};
+
+// Bounded memo of road distances between quantized map cells. A cell pair
+// stands for the junctions nearest the two cell centres and the graph distance
+// between them, so a hit costs a hash probe and two straight legs instead of a
+// search. A point whose own nearest junction differs from its cell centre's is
+// routed through the centre's junction, so answers can run long by up to about
+// a cell's width; a smaller quantum trades hit rate for accuracy. Roads are
+// two-way, so (a, b) and (b, a) share an entry. Entries sit in 4-way sets with
+// least-recently-used replacement within a set. Only the simulator's own
+// thread queries it, so it takes no locks.
+class DistanceCache {
+public:
+    static const int WAYS = 4;
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t lastUse;
+        uint32_t low, high;
+        double distance;
+    };
+    
+    const RoadNetwork* roads;
+    double quantum;
+    std::vector<Entry> entries;
+    size_t setMask;
+    uint32_t clock;
+    uint64_t hits, misses, evictions;
+    
+    // Cells are centred on multiples of quantum, so lattice points (where the
+    // simulator puts riders and destinations) are their own cell centres.
+    // 16 bits per axis: 65536 cells across is far beyond any map this runs on.
+    uint32_t cellOf(const Location& at) const {
+        uint32_t cx = (uint32_t)std::min(std::max(floor(at.getX() / quantum + 0.5), 0.0), 65535.0);
+        uint32_t cy = (uint32_t)std::min(std::max(floor(at.getY() / quantum + 0.5), 0.0), 65535.0);
+        return cy << 16 | cx;
+    }
+    
+    Location centreOf(uint32_t cell) const {
+        return Location((cell & 0xFFFF) * quantum, (cell >> 16) * quantum);
+    }
+    
+    static uint64_t keyOf(uint32_t a, uint32_t b) { return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a; }
+    
+    Entry* set(uint64_t key) {
+        uint64_t z = (key ^ (key >> 31)) * 0x9E3779B97F4A7C15ULL;
+        return &entries[((z >> 32) & setMask) * WAYS];
+    }
+    
+    // Empty ways have lastUse 0, so they are also the first chosen for replacement.
+    Entry& lookup(uint64_t key) {
+        Entry* ways = set(key);
+        Entry* victim = ways;
+        for (int w = 0; w < WAYS; w++) {
+            if (ways[w].lastUse && ways[w].key == key) {
+                ways[w].lastUse = ++clock;
+                hits++;
+                return ways[w];
+            }
+            if (ways[w].lastUse < victim->lastUse) victim = &ways[w];
+        }
+        misses++;
+        if (victim->lastUse) evictions++;
+        uint32_t low = key >> 32, high = (uint32_t)key;
+        victim->key = key;
+        victim->lastUse = ++clock;
+        victim->low = roads->junctionNear(centreOf(low));
+        victim->high = roads->junctionNear(centreOf(high));
+        victim->distance = HUGE_VAL;
+        return *victim;
+    }
+    
+    double answer(const Entry& entry, uint32_t fromCell, const Location& from, const Location& to) const {
+        bool forward = fromCell == (uint32_t)(entry.key >> 32);
+        return roads->joined(from, forward ? entry.low : entry.high, entry.distance, forward ? entry.high : entry.low, to);
+    }
+
+public:
+    DistanceCache() : roads(nullptr), quantum(1.0), setMask(0), clock(0), hits(0), misses(0), evictions(0) {}
+    
+    // capacity 0 (or no network) turns the cache off.
+    void configure(const RoadNetwork* network, size_t capacity, double cellWidth) {
+        roads = capacity ? network : nullptr;
+        quantum = cellWidth > 0 ? cellWidth : 1.0;
+        size_t sets = 1;
+        while (sets * WAYS < capacity) sets <<= 1;
+        entries.assign(roads ? sets * WAYS : 0, Entry{0, 0, 0, 0, 0.0});
+        setMask = sets - 1;
+        clock = 0;
+        hits = misses = evictions = 0;
+    }
+    
+    bool enabled() const { return roads != nullptr; }
+    size_t getCapacity() const { return entries.size(); }
+    double getQuantum() const { return quantum; }
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+    uint64_t getEvictions() const { return evictions; }
+    
+    double distance(const Location& from, const Location& to) {
+        uint32_t a = cellOf(from), b = cellOf(to);
+        Entry& entry = lookup(keyOf(a, b));
+        if (std::isinf(entry.distance)) entry.distance = roads->junctionDistance(entry.low, entry.high);
+        return answer(entry, a, from, to);
+    }
+    
+    // Hits are answered from the table; the misses share one Dijkstra from the
+    // source cell's junction.
+    void distancesFrom(const Location& from, const std::vector<Location>& targets, std::vector<double>& out) {
+        uint32_t a = cellOf(from);
+        uint32_t source = roads->junctionNear(centreOf(a));
+        out.resize(targets.size());
+        std::vector<size_t> missed;
+        std::vector<uint32_t> missedJunctions;
+        for (size_t i = 0; i < targets.size(); i++) {
+            uint32_t b = cellOf(targets[i]);
+            Entry& entry = lookup(keyOf(a, b));
+            if (std::isinf(entry.distance)) {
+                missed.push_back(i);
+                missedJunctions.push_back(roads->junctionNear(centreOf(b)));
+            } else {
+                out[i] = answer(entry, a, from, targets[i]);
+            }
+        }
+        if (missed.empty()) return;
+        std::vector<double> graph;
+        roads->junctionDistancesFrom(source, missedJunctions, graph);
+        for (size_t m = 0; m < missed.size(); m++) {
+            const Location& to = targets[missed[m]];
+            uint32_t b = cellOf(to);
+            Entry* ways = set(keyOf(a, b));
+            for (int w = 0; w < WAYS; w++) {
+                if (ways[w].lastUse && ways[w].key == keyOf(a, b)) ways[w].distance = graph[m];
+            }
+            out[missed[m]] = roads->joined(from, source, graph[m], missedJunctions[m], to);
+        }
+    }
+    
+    // Warms the cache with every pair among the `zones` cells holding the most
+    // of `points` (for instance, where riders are). Pairs beyond capacity evict
+    // one another like any other entries.
+    void precompute(const std::vector<Location>& points, size_t zones) {
+        if (!enabled() || zones == 0) return;
+        std::map<uint32_t, size_t> counts;
+        for (const Location& at : points) counts[cellOf(at)]++;
+        std::vector<std::pair<size_t, uint32_t>> ranked;
+        for (const auto& count : counts) ranked.push_back(std::make_pair(count.second, count.first));
+        std::sort(ranked.begin(), ranked.end(), std::greater<std::pair<size_t, uint32_t>>());
+        ranked.resize(std::min(ranked.size(), zones));
+        
+        std::vector<Location> centres;
+        for (const auto& zone : ranked) centres.push_back(centreOf(zone.second));
+        std::vector<double> ignored;
+        for (const Location& centre : centres) distancesFrom(centre, centres, ignored);
+    }
+};
+
+// Vehicle classes a driver can have and a request can ask for. ANY_VEHICLE is
+// only ever asked for.
+enum VehicleClass { ANY_VEHICLE, SEDAN, HATCHBACK, SUV, PREMIUM, VEHICLE_CLASS_COUNT };
+
+inline const std::string& vehicleClassName(VehicleClass vehicle) {
+    static const std::string names[] = {"Any", "Sedan", "Hatchback", "SUV", "Premium"};
+    return names[vehicle < VEHICLE_CLASS_COUNT ? vehicle : ANY_VEHICLE];
+}
+
+inline VehicleClass vehicleClassNamed(const char* name, size_t length) {
+    for (int i = SEDAN; i < VEHICLE_CLASS_COUNT; i++) {
+        const std::string& known = vehicleClassName((VehicleClass)i);
+        if (known.size() == length && memcmp(known.data(), name, length) == 0) return (VehicleClass)i;
+    }
+    return ANY_VEHICLE;
+}
+
+// Each distinct string is stored once and named by a 32-bit id. Entries never
+// move, so references from get() stay valid as the table grows.
+class StringTable {
+private:
+    std::deque<std::string> values;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+public:
+    uint32_t intern(const std::string& value) {
+        auto found = ids.find(value);
+        if (found != ids.end()) return found->second;
+        values.push_back(value);
+        uint32_t id = values.size() - 1;
+        ids.emplace(values.back(), id);
+        return id;
+    }
+    
+    const std::string& get(uint32_t id) const { return values[id]; }
+    size_t size() const { return values.size(); }
+};
+
+class Driver;
+
+// Uniform grid over the city map holding only AVAILABLE drivers, so matching
+// touches the cells around a pickup instead of the whole fleet. A driver can
+// sit in one index per layer at once (the whole fleet and its vehicle class).
+class SpatialIndex {
+private:
+    double width, height;
+    double cellSize;
+    int cols, rows;
+    std::vector<std::vector<Driver*>> cells;
+    size_t count;
+    int layer;
+
+    int cellOf(const Location& loc) const;
+    void collectRing(const Location& center, int cx, int cy, int ring, size_t k, double maxSquared,
+                     std::vector<std::pair<double, Driver*>>& best) const;
+
+public:
+    static const int LAYERS = 2;
+    
+    SpatialIndex(double width, double height, double cellSize, int layer = 0);
+    
+    size_t size() const { return count; }
+    int getCols() const { return cols; }
+    int getRows() const { return rows; }
+    double getCellSize() const { return cellSize; }
+    const std::vector<Driver*>& cellDrivers(int cell) const { return cells[cell]; }
+    
+    void insert(Driver* driver);
+    void remove(Driver* driver);
+    void update(Driver* driver);
+    
+    std::vector<Driver*> queryRadius(const Location& center, double radius) const;
+    std::vector<Driver*> kNearest(const Location& center, size_t k, double maxDistance) const;
+    Driver* nearest(const Location& center, double maxDistance) const;
+};
+
+// Recent requests against idle drivers for each square zone of the map. Requests
+// are counted as they open; supply is read off the available-driver index, whose
+// cell buckets already follow every status change and move. update() then folds
+// both into surge multipliers in one branch-free pass over the zone arrays, and
+// picks for each zone the neighbour most short of drivers, so its cost follows
+// the number of zones and not the size of the fleet.
+class ZoneHeatmap {
+public:
+    static constexpr float DEMAND_DECAY = 0.9f;   // per tick; a request weighs in for ~10 ticks
+    static constexpr float SURGE_SLOPE = 0.5f;    // surge added per request beyond one per idle driver
+    static constexpr float MAX_SURGE = 3.0f;
+    static constexpr int MAX_MOVES = 32;          // idle drivers a zone sends off per tick
+
+private:
+    double zoneSize;
+    int cols, rows;
+    std::vector<int> cellZone;            // index cell -> zone
+    std::vector<std::vector<int>> zoneCells;
+    std::vector<float> arrivals;          // requests opened since the last update
+    std::vector<float> demand;
+    std::vector<float> supply;
+    std::vector<float> surge;
+    std::vector<int> target;              // where idle drivers should go; the zone itself when nowhere
+    float peakSurge;
+
+public:
+    ZoneHeatmap() : zoneSize(0), cols(0), rows(0), peakSurge(1.0f) {}
+    
+    bool enabled() const { return cols > 0; }
+    int getZoneCount() const { return cols * rows; }
+    double getZoneSize() const { return zoneSize; }
+    double getPeakSurge() const { return peakSurge; }
+    
+    // Zones size units wide over the area index covers; size <= 0 turns the
+    // heatmap off and every zone's surge back to 1.
+    void configure(const SpatialIndex& index, double size) {
+        zoneSize = std::max(0.0, size);
+        cols = rows = 0;
+        if (zoneSize > 0) {
+            cols = std::max(1, (int)ceil(index.getCols() * index.getCellSize() / zoneSize));
+            rows = std::max(1, (int)ceil(index.getRows() * index.getCellSize() / zoneSize));
+        }
+        size_t zones = getZoneCount();
+        cellZone.assign(zones ? index.getCols() * index.getRows() : 0, 0);
+        zoneCells.assign(zones, std::vector<int>());
+        for (size_t cell = 0; cell < cellZone.size(); cell++) {
+            Location centre((cell % index.getCols() + 0.5) * index.getCellSize(), 
+                            (cell / index.getCols() + 0.5) * index.getCellSize());
+            cellZone[cell] = zoneOf(centre);
+            zoneCells[cellZone[cell]].push_back(cell);
+        }
+        arrivals.assign(zones, 0.0f);
+        demand.assign(zones, 0.0f);
+        supply.assign(zones, 0.0f);
+        surge.assign(zones, 1.0f);
+        target.resize(zones);
+        std::iota(target.begin(), target.end(), 0);
+        peakSurge = 1.0f;
+    }
+    
+    int zoneOf(const Location& at) const {
+        int zx = std::min(std::max((int)floor(at.getX() / zoneSize), 0), cols - 1);
+        int zy = std::min(std::max((int)floor(at.getY() / zoneSize), 0), rows - 1);
+        return zy * cols + zx;
+    }
+    
+    Location zoneCentre(int zone) const { 
+        return Location((zone % cols + 0.5) * zoneSize, (zone / cols + 0.5) * zoneSize); 
+    }
+    
+    const std::vector<int>& cellsOf(int zone) const { return zoneCells[zone]; }
+    int getTarget(int zone) const { return target[zone]; }
+    
+    // How many zones configure(index, size) would make, in floating point so a
+    // size read from a file can be checked before anything is allocated.
+    static double zoneCountFor(const SpatialIndex& index, double size) {
+        return ceil(index.getCols() * index.getCellSize() / size) * ceil(index.getRows() * index.getCellSize() / size);
+    }
+    
+    // Arrivals, decayed demand and surge for every zone, in that order; supply
+    // and targets are rebuilt by the next update. Used by snapshots.
+    void saveState(std::vector<float>& out) const {
+        out.insert(out.end(), arrivals.begin(), arrivals.end());
+        out.insert(out.end(), demand.begin(), demand.end());
+        out.insert(out.end(), surge.begin(), surge.end());
+    }
+    
+    void restoreState(const float* in, double peak) {
+        size_t zones = getZoneCount();
+        std::copy(in, in + zones, arrivals.begin());
+        std::copy(in + zones, in + 2 * zones, demand.begin());
+        std::copy(in + 2 * zones, in + 3 * zones, surge.begin());
+        peakSurge = peak;
+    }
+    
+    void recordRequest(const Location& pickup) {
+        if (enabled()) arrivals[zoneOf(pickup)] += 1.0f;
+    }
+    
+    double surgeAt(const Location& at) const { return enabled() ? surge[zoneOf(at)] : 1.0; }
+    
+    // Idle drivers zone should send toward its target: half the gap in
+    // shortfall, so two neighbours even out instead of trading places, and no
+    // more than MAX_MOVES so a large fleet does not make the pass expensive.
+    int surplusFor(int zone) const {
+        int to = target[zone];
+        float gap = (demand[to] - supply[to]) - (demand[zone] - supply[zone]);
+        return (int)std::min(std::min(supply[zone], gap * 0.5f), (float)MAX_MOVES);
+    }
+    
+    void update(const SpatialIndex& index) {
+        std::fill(supply.begin(), supply.end(), 0.0f);
+        for (size_t cell = 0; cell < cellZone.size(); cell++) {
+            supply[cellZone[cell]] += index.cellDrivers(cell).size();
+        }
+        
+        size_t zones = demand.size();
+        float* recent = demand.data();
+        float* opened = arrivals.data();
+        const float* idle = supply.data();
+        float* multiplier = surge.data();
+        float peak = peakSurge;
+        for (size_t z = 0; z < zones; z++) {
+            recent[z] = recent[z] * DEMAND_DECAY + opened[z];
+            opened[z] = 0.0f;
+            float pressure = recent[z] / (idle[z] + 1.0f);
+            multiplier[z] = std::min(MAX_SURGE, std::max(1.0f, 1.0f + SURGE_SLOPE * (pressure - 1.0f)));
+            peak = std::max(peak, multiplier[z]);
+        }
+        peakSurge = peak;
+        
+        // A neighbour is worth moving to only if it has demand of its own and is
+        // short by at least two drivers more than here.
+        for (int zy = 0; zy < rows; zy++) {
+            for (int zx = 0; zx < cols; zx++) {
+                int zone = zy * cols + zx;
+                int best = zone;
+                float bestShortfall = recent[zone] - idle[zone] + 2.0f;
+                for (int ny = std::max(zy - 1, 0); ny <= std::min(zy + 1, rows - 1); ny++) {
+                    for (int nx = std::max(zx - 1, 0); nx <= std::min(zx + 1, cols - 1); nx++) {
+                        int neighbour = ny * cols + nx;
+                        float shortfall = recent[neighbour] - idle[neighbour];
+                        if (recent[neighbour] > 0 && shortfall > bestShortfall) {
+                            best = neighbour;
+                            bestShortfall = shortfall;
+                        }
+                    }
+                }
+                target[zone] = best;
+            }
+        }
+    }
+};
+
+// Hot per-driver state kept as structure-of-arrays, one slot per driver. Movement
+// for every en-route driver happens in advance(), a single branch-free pass the
+// compiler vectorizes (GCC needs -O3 -fno-math-errno -fno-trapping-math).
+class DriverStore {
+public:
+    std::vector<double> x, y;
+    std::vector<double> targetX, targetY;
+    std::vector<double> speed;
+    std::vector<unsigned char> status;
+    std::vector<unsigned char> moving;
+    
+    // Membership of each status, kept on every change: a bitset over slots for
+    // scans in slot order, and a dense list of slots (with each slot's place in
+    // it) for O(1) counts and uniform sampling.
+    static const int STATUS_COUNT = 4;
+    std::vector<uint64_t> statusBits[STATUS_COUNT];
+    std::vector<int> statusSlots[STATUS_COUNT];
+    std::vector<int> statusPosition;
+    
+    size_t size() const { return x.size(); }
+    size_t countWithStatus(unsigned char value) const { return statusSlots[value].size(); }
+    const std::vector<int>& slotsWithStatus(unsigned char value) const { return statusSlots[value]; }
+    
+    // Lays the dense lists out in the given order, which holds every slot once.
+    // A snapshot restore uses it so that sampling by position replays.
+    void orderStatusSlots(const uint32_t* slots, size_t count) {
+        for (std::vector<int>& list : statusSlots) list.clear();
+        for (size_t i = 0; i < count; i++) {
+            int slot = slots[i];
+            statusPosition[slot] = statusSlots[status[slot]].size();
+            statusSlots[status[slot]].push_back(slot);
+        }
+    }
+    
+    void setStatus(int slot, unsigned char value) {
+        if (status[slot] == value) return;
+        leaveStatus(slot);
+        status[slot] = value;
+        joinStatus(slot);
+    }
+    
+    // Visits the slots holding value in ascending order. visit may change the
+    // status of the slot it is given, but of no other.
+    template <typename Visit>
+    void forEachWithStatus(unsigned char value, Visit visit) const {
+        const std::vector<uint64_t>& bits = statusBits[value];
+        for (size_t w = 0; w < bits.size(); w++) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                visit((int)(w * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+    
+    void reserve(size_t n) {
+        x.reserve(n); y.reserve(n);
+        targetX.reserve(n); targetY.reserve(n);
+        speed.reserve(n);
+        status.reserve(n);
+        moving.reserve(n);
+        statusPosition.reserve(n);
+    }
+    
+    int add(const Location& loc, double driverSpeed, unsigned char initialStatus) {
+        x.push_back(loc.getX());
+        y.push_back(loc.getY());
+        targetX.push_back(loc.getX());
+        targetY.push_back(loc.getY());
+        speed.push_back(driverSpeed);
+        status.push_back(initialStatus);
+        moving.push_back(0);
+        int slot = x.size() - 1;
+        if (slot % 64 == 0) {
+            for (std::vector<uint64_t>& bits : statusBits) bits.push_back(0);
+        }
+        statusPosition.push_back(0);
+        joinStatus(slot);
+        return slot;
+    }
+    
+    Location locationOf(int slot) const { return Location(x[slot], y[slot]); }
+    
+    void setLocation(int slot, const Location& loc) {
+        x[slot] = loc.getX();
+        y[slot] = loc.getY();
+    }
+    
+    void setTarget(int slot, const Location& target) {
+        targetX[slot] = target.getX();
+        targetY[slot] = target.getY();
+        moving[slot] = 1;
+    }
+    
+    // Steps every driver flagged by setTarget one speed unit toward its target
+    // (landing on it when it is within one step) and clears the flags for the next tick.
+    void advance() {
+        advanceRange(0, x.size());
+    }
+    
+    void advanceRange(size_t begin, size_t end) {
+        moveKernel(end - begin, x.data() + begin, y.data() + begin, targetX.data() + begin, 
+                   targetY.data() + begin, speed.data() + begin, moving.data() + begin);
+    }
+
+private:
+    void joinStatus(int slot) {
+        statusBits[status[slot]][slot / 64] |= 1ULL << (slot % 64);
+        statusPosition[slot] = statusSlots[status[slot]].size();
+        statusSlots[status[slot]].push_back(slot);
+    }
+    
+    void leaveStatus(int slot) {
+        statusBits[status[slot]][slot / 64] &= ~(1ULL << (slot % 64));
+        std::vector<int>& slots = statusSlots[status[slot]];
+        int last = slots.back();
+        slots[statusPosition[slot]] = last;
+        statusPosition[last] = statusPosition[slot];
+        slots.pop_back();
+    }
+    
+    static void moveKernel(size_t n, double* __restrict px, double* __restrict py,
+                           const double* __restrict tx, const double* __restrict ty,
+                           const double* __restrict sp, unsigned char* __restrict flags) {
+        for (size_t i = 0; i < n; i++) {
+            double nextX = px[i], nextY = py[i];
+            step(nextX, nextY, tx[i], ty[i], sp[i]);
+            bool active = flags[i];
+            px[i] = active ? nextX : px[i];
+            py[i] = active ? nextY : py[i];
+            flags[i] = 0;
+        }
+    }
+
+public:
+    // One movement step, shared by the kernel and by anything that needs to
+    // replay it for a single driver (the event engine's arrival times). A goal
+    // within reach is landed on exactly, so road junctions are actually reached.
+    static inline void step(double& x, double& y, double goalX, double goalY, double speed) {
+        double dx = goalX - x;
+        double dy = goalY - y;
+        double distance = sqrt(dx * dx + dy * dy);
+        bool far = distance > speed;
+        double scale = speed / (far ? distance : 1.0);
+        double stepX = x + dx * scale;
+        double stepY = y + dy * scale;
+        x = far ? stepX : goalX;
+        y = far ? stepY : goalY;
+    }
+};
+
+// Cold per-driver data (name, vehicle, plate, earnings). Position and status
+// live in the shared DriverStore under this driver's slot; name and plate are
+// ids into the simulator's StringTable.
+class Driver {
+public:
+    // DEPARTED marks a driver handed to another shard; the slot waits to be reused.
+    enum Status { OFFLINE, AVAILABLE, ON_TRIP, DEPARTED };
+    
+private:
+    int id;
+    uint32_t nameId;
+    uint32_t plateId;
+    VehicleClass vehicle;
+    double earnings;
+    double rating;
+    int totalTrips;
+    
+    DriverStore* store;
+    const StringTable* strings;
+    int slot;
+    EventJournal* journal;
+    
+    SpatialIndex* spatialIndex;
+    SpatialIndex* classIndex;
+    int gridCell[SpatialIndex::LAYERS];
+    int gridSlot[SpatialIndex::LAYERS];
+    
+    const RoadNetwork* roads;
+    std::vector<Location> route;
+    size_t routeStep;
+    Location routeGoal;
+    bool routed;
+    
+    friend class SpatialIndex;
+    friend class RideSharingSimulator;
+    
+    void setStatus(Status newStatus) {
+        store->setStatus(slot, newStatus);
+        for (SpatialIndex* index : {spatialIndex, classIndex}) {
+            if (!index) continue;
+            if (newStatus == AVAILABLE) {
+                index->insert(this);
+            } else {
+                index->remove(this);
+            }
+        }
+    }
+
+public:
+    static constexpr double DEFAULT_SPEED = 0.5;
+    
+    Driver(DriverStore& store, StringTable& strings, int id, const std::string& name, Location loc, 
+           VehicleClass vehicle, const std::string& plate, EventJournal* journal = nullptr) 
+        : id(id), nameId(strings.intern(name)), plateId(strings.intern(plate)), vehicle(vehicle),
+          earnings(0.0), rating(5.0), totalTrips(0),
+          store(&store), strings(&strings), slot(store.add(loc, DEFAULT_SPEED, OFFLINE)), journal(journal),
+          spatialIndex(nullptr), classIndex(nullptr), roads(nullptr), routeStep(0), routed(false) {
+        std::fill(std::begin(gridCell), std::end(gridCell), -1);
+        std::fill(std::begin(gridSlot), std::end(gridSlot), -1);
+    }
+    
+    int getId() const { return id; }
+    int getSlot() const { return slot; }
+    const std::string& getName() const { return strings->get(nameId); }
+    Location getLocation() const { return store->locationOf(slot); }
+    Status getStatus() const { return (Status)store->status[slot]; }
+    VehicleClass getVehicleClass() const { return vehicle; }
+    const std::string& getVehicleType() const { return vehicleClassName(vehicle); }
+    const std::string& getLicensePlate() const { return strings->get(plateId); }
+    double getEarnings() const { return earnings; }
+    double getRating() const { return rating; }
+    int getTotalTrips() const { return totalTrips; }
+    
+    void setLocation(Location loc) { 
+        store->setLocation(slot, loc); 
+        if (spatialIndex) spatialIndex->update(this);
+        if (classIndex) classIndex->update(this);
+    }
+    
+    // index holds every available driver, classPool those of this driver's class.
+    void attachIndex(SpatialIndex* index, SpatialIndex* classPool = nullptr) {
+        if (spatialIndex) spatialIndex->remove(this);
+        if (classIndex) classIndex->remove(this);
+        spatialIndex = index;
+        classIndex = classPool;
+        if (getStatus() != AVAILABLE) return;
+        if (spatialIndex) spatialIndex->insert(this);
+        if (classIndex) classIndex->insert(this);
+    }
+    
+    static const char* statusName(Status status) {
+        switch(status) {
+            case OFFLINE: return "OFFLINE";
+            case AVAILABLE: return "AVAILABLE";
+            case ON_TRIP: return "ON_TRIP";
+            case DEPARTED: return "DEPARTED";
+            default: return "UNKNOWN";
+        }
+    }
+    
+    std::string getStatusString() const { return statusName(getStatus()); }
+    
+    void goOnline() { 
+        setStatus(AVAILABLE); 
+        if (!journal) return;
+        journal->record(EventJournal::DRIVER_ONLINE, 0, id, 0);
+        if (journal->narrating()) {
+            journal->narrate() << " Driver " << getName() << " is now ONLINE at location " << getLocation().toString();
+        }
+    }
+    
+    void goOffline() { 
+        setStatus(OFFLINE); 
+        if (!journal) return;
+        journal->record(EventJournal::DRIVER_OFFLINE, 0, id, 0);
+        if (journal->narrating()) {
+            journal->narrate() << " Driver " << getName() << " is now OFFLINE";
+        }
+    }
+    
+    void startTrip() { 
+        setStatus(ON_TRIP); 
+        if (!journal) return;
+        journal->record(EventJournal::TRIP_STARTED, 0, id, 0);
+        if (journal->narrating()) {
+            journal->narrate() << "Driver " << getName() << " started a trip";
+        }
+    }
+    
+    void endTrip(double payment, double newRating) {
+        setStatus(AVAILABLE);
+        earnings += payment;
+        rating = (rating * totalTrips + newRating) / (totalTrips + 1);
+        totalTrips++;
+        if (!journal) return;
+        journal->record(EventJournal::TRIP_ENDED, 0, id, 0, payment);
+        if (journal->narrating()) {
+            journal->narrate() << " Driver " << getName() << " earned ₹" << std::fixed << std::setprecision(2) << payment 
+                               << " | New rating: " << std::setprecision(1) << rating;
+        }
+    }
+    
+    void attachRoads(const RoadNetwork* network) {
+        roads = network;
+        routed = false;
+    }
+    
+    // Index of the waypoint to head for: waypoints already stood on are passed.
+    static size_t nextWaypoint(const std::vector<Location>& route, size_t step, const Location& at) {
+        while (step + 1 < route.size() && at.squaredDistanceTo(route[step]) == 0) step++;
+        return step;
+    }
+    
+    // Queues one step toward target; the step itself is taken by DriverStore::advance().
+    // On a road network the step heads for the next junction on the route instead,
+    // and the route is planned once per new target.
+    void moveTowards(Location target) {
+        if (roads) {
+            if (!routed || routeGoal.squaredDistanceTo(target) != 0) {
+                route = roads->route(getLocation(), target);
+                routeStep = 0;
+                routeGoal = target;
+                routed = true;
+            }
+            routeStep = nextWaypoint(route, routeStep, getLocation());
+            target = route[routeStep];
+        }
+        store->setTarget(slot, target);
+    }
+};
+
+class Rider {
+private:
+    int id;
+    std::string name;
+    Location location;
+    bool hasActiveRide;
+    bool departed;
+    double balance;
+    EventJournal* journal;
+    
+    friend class RideSharingSimulator;
+
+public:
+    Rider(int id, std::string name, Location loc, EventJournal* journal = nullptr) 
+        : id(id), name(name), location(loc), hasActiveRide(false), departed(false), balance(1000.0), journal(journal) {}
+    
+    int getId() const { return id; }
+    const std::string& getName() const { return name; }
+    Location getLocation() const { return location; }
+    bool hasRide() const { return hasActiveRide; }
+    double getBalance() const { return balance; }
+    
+    void setRideStatus(bool status) { hasActiveRide = status; }
+    void setLocation(Location loc) { location = loc; }
+    
+    void pay(double amount) { 
+        balance -= amount; 
+        if (!journal) return;
+        journal->record(EventJournal::RIDER_PAID, 0, 0, id, amount);
+        if (journal->narrating()) {
+            journal->narrate() << name << " paid ₹" << std::fixed << std::setprecision(2) << amount 
+                               << " | Remaining balance: ₹" << balance;
+        }
+    }
+    
+    void addBalance(double amount) { 
+        balance += amount; 
+        if (!journal) return;
+        journal->record(EventJournal::WALLET_TOPUP, 0, 0, id, amount);
+        if (journal->narrating()) {
+            journal->narrate() << name << " added ₹" << std::fixed << std::setprecision(2) << amount << " to wallet";
+        }
+    }
+};
+
+// Generational reference into a SlotMap. A handle goes stale as soon as its
+// element is removed, even if the slot is later reused.
+struct Handle {
+    uint32_t index;
+    uint32_t generation;
+    
+    bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Dense storage with O(1) insert and swap-remove. Elements are contiguous for
+// iteration; a slot table maps stable handles to their current position.
+template <typename T>
+class SlotMap {
+private:
+    struct Slot {
+        uint32_t dense;
+        uint32_t generation;
+    };
+    
+    std::vector<T> items;
+    std::vector<uint32_t> owners;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+public:
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    
+    void reserve(size_t n) {
+        items.reserve(n);
+        owners.reserve(n);
+        slots.reserve(n);
+    }
+    
+    Handle insert(T item) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = slots.size();
+            slots.push_back(Slot{0, 1});
+        }
+        slots[slot].dense = items.size();
+        items.push_back(std::move(item));
+        owners.push_back(slot);
+        return Handle{slot, slots[slot].generation};
+    }
+    
+    bool contains(Handle handle) const {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+    
+    T* get(Handle handle) { return contains(handle) ? &items[slots[handle.index].dense] : nullptr; }
+    const T* get(Handle handle) const { return contains(handle) ? &items[slots[handle.index].dense] : nullptr; }
+    
+    bool remove(Handle handle) {
+        if (!contains(handle)) return false;
+        removeAt(slots[handle.index].dense);
+        return true;
+    }
+    
+    // Moves the last element into position; iterate by index and revisit it after removal.
+    void removeAt(size_t dense) {
+        uint32_t slot = owners[dense];
+        size_t last = items.size() - 1;
+        if (dense != last) {
+            items[dense] = std::move(items[last]);
+            owners[dense] = owners[last];
+            slots[owners[dense]].dense = dense;
+        }
+        items.pop_back();
+        owners.pop_back();
+        slots[slot].generation++;
+        freeSlots.push_back(slot);
+    }
+    
+    size_t indexOf(Handle handle) const { return slots[handle.index].dense; }
+    
+    Handle handleAt(size_t dense) const {
+        uint32_t slot = owners[dense];
+        return Handle{slot, slots[slot].generation};
+    }
+    
+    T& operator[](size_t dense) { return items[dense]; }
+    const T& operator[](size_t dense) const { return items[dense]; }
+    
+    typename std::vector<T>::iterator begin() { return items.begin(); }
+    typename std::vector<T>::iterator end() { return items.end(); }
+    typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+    typename std::vector<T>::const_iterator end() const { return items.end(); }
+};
+
+// Persistent workers for data-parallel loops. Each worker starts on an equal
+// slice of the index range; once its slice runs dry it steals the back half of
+// another worker's slice, so items of uneven cost do not leave cores idle.
+// The calling thread takes part as worker 0.
+class WorkStealingPool {
+private:
+    struct alignas(64) Slice {
+        std::atomic<uint64_t> bounds;
+    };
+    
+    size_t threadCount;
+    std::unique_ptr<Slice[]> slices;
+    std::vector<std::thread> workers;
+    
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, size_t)>* job;
+    uint32_t grain;
+    uint64_t generation;
+    size_t running;
+    bool stopping;
+    
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+    
+    bool takeFront(Slice& slice, uint32_t& begin, uint32_t& end) {
+        uint64_t current = slice.bounds.load();
+        while (true) {
+            uint32_t first = current >> 32;
+            uint32_t last = (uint32_t)current;
+            if (first >= last) return false;
+            uint32_t split = std::min(first + grain, last);
+            if (slice.bounds.compare_exchange_weak(current, pack(split, last))) {
+                begin = first;
+                end = split;
+                return true;
+            }
+        }
+    }
+    
+    bool stealBack(Slice& slice, uint32_t& begin, uint32_t& end) {
+        uint64_t current = slice.bounds.load();
+        while (true) {
+            uint32_t first = current >> 32;
+            uint32_t last = (uint32_t)current;
+            if (first >= last) return false;
+            uint32_t middle = first + (last - first) / 2;
+            if (slice.bounds.compare_exchange_weak(current, pack(first, middle))) {
+                begin = middle;
+                end = last;
+                return true;
+            }
+        }
+    }
+    
+    void work(size_t self) {
+        uint32_t begin, end;
+        while (true) {
+            while (takeFront(slices[self], begin, end)) {
+                (*job)(begin, end);
+            }
+            bool stole = false;
+            for (size_t k = 1; k < threadCount && !stole; k++) {
+                if (stealBack(slices[(self + k) % threadCount], begin, end)) {
+                    slices[self].bounds.store(pack(begin, end));
+                    stole = true;
+                }
+            }
+            if (!stole) return;
+        }
+    }
+    
+    void workerLoop(size_t self) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            work(self);
+            std::lock_guard<std::mutex> guard(lock);
+            if (--running == 0) done.notify_one();
+        }
+    }
+
+public:
+    explicit WorkStealingPool(size_t threads = 1)
+        : threadCount(std::max<size_t>(1, threads)), slices(new Slice[threadCount]), 
+          job(nullptr), grain(1), generation(0), running(0), stopping(false) {
+        for (size_t t = 1; t < threadCount; t++) {
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, t);
+        }
+    }
+    
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+    
+    size_t size() const { return threadCount; }
+    
+    // Calls fn(begin, end) over disjoint sub-ranges covering [0, n), at most
+    // chunkSize items at a time, and returns once every item has been processed.
+    void parallelFor(size_t n, size_t chunkSize, const std::function<void(size_t, size_t)>& fn) {
+        if (n == 0) return;
+        if (threadCount == 1 || n <= chunkSize) {
+            fn(0, n);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t t = 0; t < threadCount; t++) {
+                slices[t].bounds.store(pack(n * t / threadCount, n * (t + 1) / threadCount));
+            }
+            job = &fn;
+            grain = std::max<size_t>(1, chunkSize);
+            running = threadCount - 1;
+            generation++;
+        }
+        wake.notify_all();
+        work(0);
+        
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return running == 0; });
+        job = nullptr;
+    }
+};
+
+// Unbounded lock-free queue between one producer thread and one consumer
+// thread, kept as a chain of fixed-size blocks. The producer only writes the
+// tail block and the consumer only reads the head; each side publishes its
+// progress with a single release store, so neither ever waits for the other.
+template <typename T>
+class SpscQueue {
+private:
+    static const size_t BLOCK_ITEMS = 64;
+    
+    struct Block {
+        alignas(T) unsigned char storage[BLOCK_ITEMS * sizeof(T)];
+        std::atomic<size_t> published{0};
+        std::atomic<Block*> next{nullptr};
+        
+        T* item(size_t i) { return reinterpret_cast<T*>(storage) + i; }
+    };
+    
+    alignas(64) Block* head;
+    size_t consumed;
+    alignas(64) Block* tail;
+
+public:
+    SpscQueue() : head(new Block()), consumed(0), tail(head) {}
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    ~SpscQueue() {
+        drain([](T&&) {});
+        delete head;
+    }
+    
+    // Producer side.
+    void push(T value) {
+        size_t count = tail->published.load(std::memory_order_relaxed);
+        if (count == BLOCK_ITEMS) {
+            Block* block = new Block();
+            tail->next.store(block, std::memory_order_release);
+            tail = block;
+            count = 0;
+        }
+        new (tail->item(count)) T(std::move(value));
+        tail->published.store(count + 1, std::memory_order_release);
+    }
+    
+    // Consumer side: hands every item published so far to consume, oldest first.
+    template <typename Consume>
+    size_t drain(Consume consume) {
+        size_t taken = 0;
+        while (true) {
+            size_t available = head->published.load(std::memory_order_acquire);
+            while (consumed < available) {
+                T* item = head->item(consumed++);
+                consume(std::move(*item));
+                item->~T();
+                taken++;
+            }
+            if (consumed < BLOCK_ITEMS) return taken;
+            Block* next = head->next.load(std::memory_order_acquire);
+            if (!next) return taken;
+            delete head;
+            head = next;
+            consumed = 0;
+        }
+    }
+};
+
+// Bounded lock-free queue for any number of producer threads and one consumer,
+// after Vyukov's array queue. Each cell carries a sequence number saying whose
+// turn it is: producers claim a position with one CAS and publish the cell by
+// advancing its sequence; the consumer frees it by advancing it a lap further.
+// push() fails rather than waits when the ring is full.
+template <typename T>
+class MpscQueue {
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePosition;
+    alignas(64) size_t dequeuePosition;
+
+public:
+    explicit MpscQueue(size_t capacity) : enqueuePosition(0), dequeuePosition(0) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+    
+    size_t capacity() const { return mask + 1; }
+    
+    // Any thread.
+    bool push(const T& value) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t lag = (intptr_t)sequence - (intptr_t)position;
+            if (lag == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Consumer thread only: appends up to limit items to out, oldest first.
+    size_t popBatch(std::vector<T>& out, size_t limit) {
+        size_t taken = 0;
+        while (taken < limit) {
+            Cell& cell = cells[dequeuePosition & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) break;
+            out.push_back(cell.value);
+            cell.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+            dequeuePosition++;
+            taken++;
+        }
+        return taken;
+    }
+};
+
+// Sparse min-cost assignment by Bertsekas' forward auction. Rides bid for
+// drivers along their candidate edges; each bid raises the driver's price by
+// the bidder's margin over its second choice plus epsilon. Every ride also has
+// a private "stay unmatched" option at unmatchedCost, which caps prices so the
+// auction ends even when no complete matching exists. A driver that is never
+// bid on keeps price 0, so the result is within persons * epsilon of optimal.
+class AuctionMatcher {
+public:
+    struct Edge {
+        int object;
+        double cost;
+    };
+    
+    // offsets has one entry per person plus a sentinel; person i's edges are
+    // edges[offsets[i] .. offsets[i+1]). Returns the object per person or -1.
+    static std::vector<int> solve(const std::vector<int>& offsets, const std::vector<Edge>& edges, int objects,
+                             double epsilon, double unmatchedCost) {
+        int persons = offsets.size() - 1;
+        std::vector<int> assigned(persons, -1);
+        std::vector<int> owner(objects, -1);
+        std::vector<double> price(objects, 0.0);
+        std::deque<int> unassigned;
+        for (int i = 0; i < persons; i++) unassigned.push_back(i);
+        
+        while (!unassigned.empty()) {
+            int person = unassigned.front();
+            unassigned.pop_front();
+            
+            double best = -unmatchedCost;
+            double second = -unmatchedCost;
+            int bestObject = -1;
+            for (int e = offsets[person]; e < offsets[person + 1]; e++) {
+                double value = -edges[e].cost - price[edges[e].object];
+                if (value > best) {
+                    second = best;
+                    best = value;
+                    bestObject = edges[e].object;
+                } else if (value > second) {
+                    second = value;
+                }
+            }
+            if (bestObject < 0) continue;
+            
+            price[bestObject] += best - second + epsilon;
+            if (owner[bestObject] >= 0) {
+                assigned[owner[bestObject]] = -1;
+                unassigned.push_back(owner[bestObject]);
+            }
+            owner[bestObject] = person;
+            assigned[person] = bestObject;
+        }
+        return assigned;
+    }
+};
+
+typedef Handle RideHandle;
+
+// Plain value stored in the simulator's ride pool. Rider and driver are referenced
+// by id; the simulator resolves them and passes them into each transition.
+class Ride {
+public:
+    enum RideStatus { REQUESTED, DRIVER_ASSIGNED, PICKUP_REACHED, IN_PROGRESS, COMPLETED, CANCELLED };
+    
+    static constexpr double ARRIVAL_RADIUS = 1.0;
+
+private:
+    int id;
+    int riderId;
+    int driverId;
+    Location pickup;
+    Location destination;
+    RideStatus status;
+    double fare;
+    double distance;
+    bool arrived;
+    bool unjournaled;   // update() changed phase; journalUpdate() has not yet said so
+    VehicleClass vehicle;
+    long requestedAt;
+    long pickedUpAt;
+    long completedAt;
+    EventJournal* journal;
+    
+    friend class RideSharingSimulator;
+
+public:
+    Ride(int id, const Rider& rider, Location pickup, Location destination, long requestedAt = 0, 
+         EventJournal* journal = nullptr, double surge = 1.0, double routeDistance = -1)
+        : id(id), riderId(rider.getId()), driverId(0), pickup(pickup), destination(destination), 
+          status(REQUESTED), fare(0.0), arrived(false), unjournaled(false), vehicle(ANY_VEHICLE), requestedAt(requestedAt), 
+          pickedUpAt(requestedAt), completedAt(requestedAt), journal(journal) {
+        calculateFare(surge, routeDistance);
+    }
+    
+    int getId() const { return id; }
+    int getRiderId() const { return riderId; }
+    int getDriverId() const { return driverId; }
+    bool hasDriver() const { return driverId != 0; }
+    Location getPickup() const { return pickup; }
+    Location getDestination() const { return destination; }
+    VehicleClass getVehicleClass() const { return vehicle; }
+    RideStatus getStatus() const { return status; }
+    double getFare() const { return fare; }
+    double getDistance() const { return distance; }
+    long getRequestedAt() const { return requestedAt; }
+    long getPickedUpAt() const { return pickedUpAt; }
+    long getCompletedAt() const { return completedAt; }
+    long getWaitTicks() const { return pickedUpAt - requestedAt; }
+    long getTripTicks() const { return completedAt - pickedUpAt; }
+    bool isFinished() const { return status == COMPLETED || status == CANCELLED; }
+    bool awaitingSettlement() const { return arrived && status == IN_PROGRESS; }
+    
+    static const char* statusName(RideStatus status) {
+        switch(status) {
+            case REQUESTED: return "REQUESTED";
+            case DRIVER_ASSIGNED: return "DRIVER_ASSIGNED";
+            case PICKUP_REACHED: return "PICKUP_REACHED";
+            case IN_PROGRESS: return "IN_PROGRESS";
+            case COMPLETED: return "COMPLETED";
+            case CANCELLED: return "CANCELLED";
+            default: return "UNKNOWN";
+        }
+    }
+    
+    std::string getStatusString() const { return statusName(status); }
+    
+    void assignDriver(Driver& driver, Rider& rider) {
+        driverId = driver.getId();
+        status = DRIVER_ASSIGNED;
+        driver.startTrip();
+        rider.setRideStatus(true);
+        
+        if (!journal) return;
+        journal->record(EventJournal::RIDE_ASSIGNED, id, driverId, riderId, fare);
+        if (journal->narrating()) {
+            journal->narrate() << "Ride #" << id << " assigned to " << driver.getName() 
+                               << " (" << driver.getVehicleType() << ")";
+            journal->narrate() << " Pickup: " << pickup.toString() << " → Destination: " << destination.toString();
+            journal->narrate() << " Fare: ₹" << std::fixed << std::setprecision(2) << fare << " | Distance: " << distance << " km";
+        }
+    }
+    
+    // Touches only this ride's own driver and rider, so rides can be updated in
+    // parallel. Reaching the destination just sets awaitingSettlement(); the
+    // simulator calls completeRide() afterwards. Nothing is journalled here:
+    // the simulator calls journalUpdate() from its serial pass, so the journal
+    // comes out in pool order whatever the thread count.
+    void update(Driver& driver, long tick) {
+        if (!hasDriver() || isFinished() || arrived) return;
+        
+        switch(status) {
+            case DRIVER_ASSIGNED:
+                if (driver.getLocation().distanceTo(pickup) < ARRIVAL_RADIUS) {
+                    status = PICKUP_REACHED;
+                    pickedUpAt = tick;
+                    unjournaled = true;
+                } else {
+                    driver.moveTowards(pickup);
+                }
+                break;
+                
+            case PICKUP_REACHED:
+                status = IN_PROGRESS;
+                unjournaled = true;
+                break;
+                
+            case IN_PROGRESS:
+                if (driver.getLocation().distanceTo(destination) < ARRIVAL_RADIUS) {
+                    markArrived();
+                } else {
+                    driver.moveTowards(destination);
+                }
+                break;
+                
+            default:
+                break;
+        }
+    }
+    
+    bool hasUnjournaledUpdate() const { return unjournaled; }
+    
+    // Journals the phase the last update() moved this ride into.
+    void journalUpdate(Driver& driver, Rider& rider) {
+        unjournaled = false;
+        if (status == PICKUP_REACHED) journalPickup(driver, rider);
+        if (status == IN_PROGRESS) journalStart(rider);
+    }
+    
+    void reachPickup(Driver& driver, Rider& rider, long tick) {
+        status = PICKUP_REACHED;
+        pickedUpAt = tick;
+        journalPickup(driver, rider);
+    }
+    
+    void beginTrip(Rider& rider) {
+        status = IN_PROGRESS;
+        journalStart(rider);
+    }
+    
+    void journalPickup(Driver& driver, Rider& rider) {
+        if (!journal) return;
+        journal->record(EventJournal::PICKUP_REACHED, id, driverId, riderId);
+        if (journal->narrating()) {
+            journal->narrate() << " Driver " << driver.getName() << " reached pickup point for " << rider.getName();
+        }
+    }
+    
+    void journalStart(Rider& rider) {
+        if (!journal) return;
+        journal->record(EventJournal::RIDE_STARTED, id, driverId, riderId);
+        if (journal->narrating()) {
+            journal->narrate() << " Ride #" << id << " started! " << rider.getName() << " is on the way";
+        }
+    }
+    
+    void markArrived() { arrived = true; }
+    
+    void completeRide(Driver& driver, Rider& rider, long tick) {
+        status = COMPLETED;
+        completedAt = tick;
+        rider.pay(fare);
+        driver.endTrip(fare, 5.0); 
+        rider.setRideStatus(false);
+        rider.setLocation(destination);
+        
+        if (!journal) return;
+        journal->record(EventJournal::RIDE_COMPLETED, id, driverId, riderId, fare);
+        if (journal->narrating()) {
+            journal->narrate() << "Ride #" << id << " completed! " << rider.getName() << " reached destination";
+        }
+    }
+    
+    void cancelRide(Driver* driver, Rider& rider) {
+        status = CANCELLED;
+        if (driver) {
+            driver->goOnline();
+        }
+        rider.setRideStatus(false);
+        
+        if (!journal) return;
+        journal->record(EventJournal::RIDE_CANCELLED, id, driverId, riderId);
+        if (journal->narrating()) {
+            journal->narrate() << " Ride #" << id << " cancelled";
+        }
+    }
+
+private:
+    // routeDistance < 0 means the straight line between pickup and destination.
+    void calculateFare(double surge, double routeDistance) {
+        distance = routeDistance >= 0 ? routeDistance : pickup.distanceTo(destination);
+        fare = (distance * 8.0 + 20.0) * surge; 
+    }
+};
+
+// Completed rides, stored column by column in fixed-size chunks. Only the chunk
+// being filled lives on the heap; full chunks are appended to a spill file and
+// mapped back read-only one at a time while forEachChunk() walks them, so the
+// resident footprint stays at one chunk however long the simulation runs.
+class RideArchive {
+public:
+    static const size_t CHUNK_RIDES = 16384;
+    
+    struct Chunk {
+        size_t size;
+        const int32_t* id;
+        const int32_t* riderId;
+        const int32_t* driverId;
+        const double* pickupX;
+        const double* pickupY;
+        const double* destinationX;
+        const double* destinationY;
+        const double* fare;
+        const double* distance;
+        const int64_t* requestedAt;
+        const int64_t* pickedUpAt;
+        const int64_t* completedAt;
+    };
+
+private:
+    static const size_t INT_COLUMNS = 3;
+    static const size_t DOUBLE_COLUMNS = 6;
+    static const size_t TICK_COLUMNS = 3;
+    static const size_t CHUNK_BYTES = CHUNK_RIDES * 
+        (INT_COLUMNS * sizeof(int32_t) + DOUBLE_COLUMNS * sizeof(double) + TICK_COLUMNS * sizeof(int64_t));
+    
+    std::vector<int32_t> ints[INT_COLUMNS];
+    std::vector<double> doubles[DOUBLE_COLUMNS];
+    std::vector<int64_t> ticks[TICK_COLUMNS];
+    std::vector<std::vector<char>> resident;  // full chunks kept in memory when no spill file could be opened
+    FILE* spillFile;
+    bool spillFailed;
+    size_t spilledChunks;
+    size_t count;
+    size_t omitted;
+    
+    size_t pending() const { return ints[0].size(); }
+    
+    // Full chunks share one layout: every int column, then every double column,
+    // then every tick column, each CHUNK_RIDES entries long.
+    static Chunk view(const char* base, size_t size) {
+        Chunk chunk;
+        chunk.size = size;
+        const int32_t* i = (const int32_t*)base;
+        chunk.id = i; chunk.riderId = i + CHUNK_RIDES; chunk.driverId = i + 2 * CHUNK_RIDES;
+        const double* d = (const double*)(i + INT_COLUMNS * CHUNK_RIDES);
+        chunk.pickupX = d; chunk.pickupY = d + CHUNK_RIDES;
+        chunk.destinationX = d + 2 * CHUNK_RIDES; chunk.destinationY = d + 3 * CHUNK_RIDES;
+        chunk.fare = d + 4 * CHUNK_RIDES; chunk.distance = d + 5 * CHUNK_RIDES;
+        const int64_t* t = (const int64_t*)(d + DOUBLE_COLUMNS * CHUNK_RIDES);
+        chunk.requestedAt = t; chunk.pickedUpAt = t + CHUNK_RIDES; chunk.completedAt = t + 2 * CHUNK_RIDES;
+        return chunk;
+    }
+    
+    Chunk pendingView() const {
+        Chunk chunk;
+        chunk.size = pending();
+        chunk.id = ints[0].data(); chunk.riderId = ints[1].data(); chunk.driverId = ints[2].data();
+        chunk.pickupX = doubles[0].data(); chunk.pickupY = doubles[1].data();
+        chunk.destinationX = doubles[2].data(); chunk.destinationY = doubles[3].data();
+        chunk.fare = doubles[4].data(); chunk.distance = doubles[5].data();
+        chunk.requestedAt = ticks[0].data(); chunk.pickedUpAt = ticks[1].data(); chunk.completedAt = ticks[2].data();
+        return chunk;
+    }
+    
+    bool writeColumns(FILE* out) const {
+        for (const std::vector<int32_t>& column : ints) {
+            if (fwrite(column.data(), sizeof(int32_t), CHUNK_RIDES, out) != CHUNK_RIDES) return false;
+        }
+        for (const std::vector<double>& column : doubles) {
+            if (fwrite(column.data(), sizeof(double), CHUNK_RIDES, out) != CHUNK_RIDES) return false;
+        }
+        for (const std::vector<int64_t>& column : ticks) {
+            if (fwrite(column.data(), sizeof(int64_t), CHUNK_RIDES, out) != CHUNK_RIDES) return false;
+        }
+        return fflush(out) == 0;
+    }
+    
+    void sealChunk() {
+        if (!spillFile && !spillFailed) spillFile = tmpfile();
+        if (spillFile && !spillFailed && writeColumns(spillFile)) {
+            spilledChunks++;
+        } else {
+            // A short write leaves the file tail unusable; later chunks stay resident.
+            spillFailed = true;
+            std::vector<char> bytes;
+            bytes.reserve(CHUNK_BYTES);
+            for (const std::vector<int32_t>& column : ints) 
+                bytes.insert(bytes.end(), (const char*)column.data(), (const char*)(column.data() + CHUNK_RIDES));
+            for (const std::vector<double>& column : doubles) 
+                bytes.insert(bytes.end(), (const char*)column.data(), (const char*)(column.data() + CHUNK_RIDES));
+            for (const std::vector<int64_t>& column : ticks) 
+                bytes.insert(bytes.end(), (const char*)column.data(), (const char*)(column.data() + CHUNK_RIDES));
+            resident.push_back(std::move(bytes));
+        }
+        for (std::vector<int32_t>& column : ints) column.clear();
+        for (std::vector<double>& column : doubles) column.clear();
+        for (std::vector<int64_t>& column : ticks) column.clear();
+    }
+
+public:
+    RideArchive() : spillFile(nullptr), spillFailed(false), spilledChunks(0), count(0), omitted(0) {
+        for (std::vector<int32_t>& column : ints) column.reserve(CHUNK_RIDES);
+        for (std::vector<double>& column : doubles) column.reserve(CHUNK_RIDES);
+        for (std::vector<int64_t>& column : ticks) column.reserve(CHUNK_RIDES);
+    }
+    
+    ~RideArchive() {
+        if (spillFile) fclose(spillFile);
+    }
+    
+    RideArchive(const RideArchive&) = delete;
+    RideArchive& operator=(const RideArchive&) = delete;
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t getOmittedRides() const { return omitted; }
+    size_t getSpilledChunks() const { return spilledChunks; }
+    size_t getSpilledBytes() const { return spilledChunks * CHUNK_BYTES; }
+    size_t getResidentRides() const { return pending() + resident.size() * CHUNK_RIDES; }
+    
+    // omittedRides is how many completed rides the statistics count that this
+    // archive will not hold, such as those before a restored snapshot.
+    void clear(size_t omittedRides = 0) {
+        omitted = omittedRides;
+        for (std::vector<int32_t>& column : ints) column.clear();
+        for (std::vector<double>& column : doubles) column.clear();
+        for (std::vector<int64_t>& column : ticks) column.clear();
+        resident.clear();
+        if (spillFile && !spillFailed) {
+            rewind(spillFile);
+            spillFailed = ftruncate(fileno(spillFile), 0) != 0;
+        }
+        spilledChunks = 0;
+        count = 0;
+    }
+    
+    // Spills to an unnamed temporary file by default; this names it instead.
+    bool openSpillFile(const std::string& path) {
+        if (spilledChunks > 0 || !resident.empty()) return false;
+        FILE* file = fopen(path.c_str(), "w+b");
+        if (!file) return false;
+        if (spillFile) fclose(spillFile);
+        spillFile = file;
+        return true;
+    }
+    
+    void append(const Ride& ride) {
+        ints[0].push_back(ride.getId());
+        ints[1].push_back(ride.getRiderId());
+        ints[2].push_back(ride.getDriverId());
+        doubles[0].push_back(ride.getPickup().getX());
+        doubles[1].push_back(ride.getPickup().getY());
+        doubles[2].push_back(ride.getDestination().getX());
+        doubles[3].push_back(ride.getDestination().getY());
+        doubles[4].push_back(ride.getFare());
+        doubles[5].push_back(ride.getDistance());
+        ticks[0].push_back(ride.getRequestedAt());
+        ticks[1].push_back(ride.getPickedUpAt());
+        ticks[2].push_back(ride.getCompletedAt());
+        count++;
+        if (pending() == CHUNK_RIDES) sealChunk();
+    }
+    
+    // Visits chunks oldest first. Spilled chunks are mapped for the duration of
+    // the callback only, so the pointers in a Chunk must not be kept.
+    template <typename Fn>
+    bool forEachChunk(Fn fn) const {
+        for (size_t k = 0; k < spilledChunks; k++) {
+            void* mapped = mmap(nullptr, CHUNK_BYTES, PROT_READ, MAP_SHARED, fileno(spillFile), k * CHUNK_BYTES);
+            if (mapped == MAP_FAILED) return false;
+            madvise(mapped, CHUNK_BYTES, MADV_SEQUENTIAL);
+            fn(view((const char*)mapped, CHUNK_RIDES));
+            munmap(mapped, CHUNK_BYTES);
+        }
+        for (const std::vector<char>& bytes : resident) {
+            fn(view(bytes.data(), CHUNK_RIDES));
+        }
+        if (pending() > 0) fn(pendingView());
+        return true;
+    }
+};
+
+// Replays recorded demand from a trip trace, in either of two formats:
+//   CSV:    tick,pickup_x,pickup_y,destination_x,destination_y[,vehicle]
+//           (an optional header line is skipped; vehicle is Sedan, Hatchback, SUV or Premium)
+//   binary: the 8 bytes "RIDETRC1", then packed TraceRecord structs in host byte order.
+// The file is memory-mapped and parsed in place, and pages behind the cursor are
+// released as it advances, so a trace of any size replays in constant memory.
+// Rows must be in non-decreasing tick order; malformed rows are counted and skipped.
+class TripTraceReader {
+public:
+    struct Trip {
+        long tick;
+        Location pickup;
+        Location destination;
+        VehicleClass vehicle;
+    };
+    
+    struct TraceRecord {
+        int64_t tick;
+        double pickupX, pickupY;
+        double destinationX, destinationY;
+        int32_t vehicle;
+        int32_t reserved;
+    };
+
+private:
+    static constexpr char BINARY_MAGIC[8] = {'R', 'I', 'D', 'E', 'T', 'R', 'C', '1'};
+    static const size_t RELEASE_BYTES = 64 << 20;
+    
+    const char* data;
+    size_t size;
+    const char* cursor;
+    const char* released;
+    bool binary;
+    size_t rows;
+    size_t skipped;
+    Trip held;          // handed back by unread(), returned by the next call to next()
+    bool holding;
+    long origin;        // simulator tick of trace tick 0; -1 until a replay starts
+    
+    static void skipBlanks(const char*& p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+    }
+    
+    static bool parseNumber(const char*& p, const char* end, double& value) {
+        skipBlanks(p, end);
+        const char* start = p;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) p++;
+        double result = 0;
+        const char* digits = p;
+        while (p < end && *p >= '0' && *p <= '9') result = result * 10 + (*p++ - '0');
+        if (p < end && *p == '.') {
+            p++;
+            double scale = 0.1;
+            while (p < end && *p >= '0' && *p <= '9') {
+                result += (*p++ - '0') * scale;
+                scale *= 0.1;
+            }
+        }
+        if (p == digits || (p == digits + 1 && *digits == '.')) {
+            p = start;
+            return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negativeExponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+')) p++;
+            int exponent = 0;
+            while (p < end && *p >= '0' && *p <= '9' && exponent < 400) exponent = exponent * 10 + (*p++ - '0');
+            result *= pow(10.0, negativeExponent ? -exponent : exponent);
+        }
+        value = negative ? -result : result;
+        return true;
+    }
+    
+    static bool expect(const char*& p, const char* end, char separator) {
+        skipBlanks(p, end);
+        if (p < end && *p == separator) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+    
+    // A row is the five numbers and an optional vehicle name, each of which may
+    // have blanks around it; anything else left on the line rejects the row.
+    bool parseLine(const char* p, const char* end, Trip& trip) const {
+        double tick, px, py, dx, dy;
+        if (!parseNumber(p, end, tick) || !expect(p, end, ',') || !parseNumber(p, end, px) || !expect(p, end, ',') ||
+            !parseNumber(p, end, py) || !expect(p, end, ',') || !parseNumber(p, end, dx) || !expect(p, end, ',') ||
+            !parseNumber(p, end, dy)) return false;
+        trip.tick = (long)tick;
+        trip.pickup = Location(px, py);
+        trip.destination = Location(dx, dy);
+        trip.vehicle = ANY_VEHICLE;
+        if (expect(p, end, ',')) {
+            skipBlanks(p, end);
+            const char* name = p;
+            while (p < end && *p != ',' && *p != ' ' && *p != '\t') p++;
+            trip.vehicle = vehicleClassNamed(name, p - name);
+            skipBlanks(p, end);
+        }
+        return p == end;
+    }
+    
+    // Drops already-parsed pages from this process; they are re-read from the
+    // file only if touched again, which a forward scan never does.
+    void releaseBehindCursor() {
+        if ((size_t)(cursor - released) < RELEASE_BYTES) return;
+        size_t page = sysconf(_SC_PAGESIZE);
+        const char* upTo = data + ((cursor - data) / page) * page;
+        madvise((void*)released, upTo - released, MADV_DONTNEED);
+        released = upTo;
+    }
+
+public:
+    TripTraceReader() : data(nullptr), size(0), cursor(nullptr), released(nullptr), binary(false), rows(0), skipped(0),
+                        holding(false), origin(-1) {}
+    
+    ~TripTraceReader() { close(); }
+    
+    TripTraceReader(const TripTraceReader&) = delete;
+    TripTraceReader& operator=(const TripTraceReader&) = delete;
+    
+    size_t getRows() const { return rows; }
+    size_t getSkipped() const { return skipped; }
+    bool isBinary() const { return binary; }
+    long getOrigin() const { return origin; }
+    void setOrigin(long tick) { origin = tick; }
+    
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size = info.st_size;
+        if (size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                size = 0;
+                return false;
+            }
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            data = (const char*)mapped;
+        }
+        ::close(fd);
+        cursor = released = data;
+        binary = size >= sizeof(BINARY_MAGIC) && memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0;
+        if (binary) {
+            cursor += sizeof(BINARY_MAGIC);
+            if ((size - sizeof(BINARY_MAGIC)) % sizeof(TraceRecord) != 0) skipped++;
+        }
+        return true;
+    }
+    
+    void close() {
+        if (data) munmap((void*)data, size);
+        data = cursor = released = nullptr;
+        size = 0;
+        rows = skipped = 0;
+        holding = false;
+        origin = -1;
+    }
+    
+    // Gives back the trip next() just returned, for a reader that read one row
+    // too far; the following next() returns it again.
+    void unread(const Trip& trip) {
+        held = trip;
+        holding = true;
+    }
+    
+    bool next(Trip& trip) {
+        if (holding) {
+            trip = held;
+            holding = false;
+            return true;
+        }
+        const char* end = data + size;
+        if (binary) {
+            if ((size_t)(end - cursor) < sizeof(TraceRecord)) return false;
+            TraceRecord record;
+            memcpy(&record, cursor, sizeof(record));
+            cursor += sizeof(record);
+            trip.tick = record.tick;
+            trip.pickup = Location(record.pickupX, record.pickupY);
+            trip.destination = Location(record.destinationX, record.destinationY);
+            trip.vehicle = record.vehicle >= ANY_VEHICLE && record.vehicle <= PREMIUM ? (VehicleClass)record.vehicle : ANY_VEHICLE;
+            rows++;
+            releaseBehindCursor();
+            return true;
+        }
+        while (cursor < end) {
+            const char* lineEnd = (const char*)memchr(cursor, '\n', end - cursor);
+            if (!lineEnd) lineEnd = end;
+            const char* line = cursor;
+            const char* stop = lineEnd > line && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+            bool header = line == data;
+            cursor = lineEnd < end ? lineEnd + 1 : end;
+            releaseBehindCursor();
+            if (stop == line) continue;
+            if (parseLine(line, stop, trip)) {
+                rows++;
+                return true;
+            }
+            if (!header) skipped++;
+        }
+        return false;
+    }
+};
+
+// Named operating scenario, resolved from its name once when selected.
+struct ScenarioProfile {
+    std::string name;
+    double driverOnlineRate;  // share of the fleet on shift
+    double rideRequestRate;   // requests per rider per simulated hour
+    double surge;             // fare multiplier
+};
+
+// Time-of-day curve over scenario profiles. Each keyframe pins a profile to an
+// hour of the simulated day; in between, every rate is interpolated linearly,
+// and the last keyframe wraps round to the first. Profiles are copied in when
+// the schedule is built, so evaluating it is a search over a few keyframes.
+class DemandSchedule {
+public:
+    struct Keyframe {
+        double hour;
+        ScenarioProfile profile;
+    };
+
+private:
+    std::vector<Keyframe> keyframes;
+    int ticksPerHour;
+
+public:
+    explicit DemandSchedule(int ticksPerHour = 60) : ticksPerHour(std::max(1, ticksPerHour)) {}
+    
+    bool empty() const { return keyframes.empty(); }
+    int getTicksPerHour() const { return ticksPerHour; }
+    const std::vector<Keyframe>& getKeyframes() const { return keyframes; }
+    
+    // The keyframes as the hour:scenario list setSchedule reads.
+    std::string describe() const {
+        std::ostringstream spec;
+        for (size_t i = 0; i < keyframes.size(); i++) {
+            spec << (i ? "," : "") << keyframes[i].hour << ":" << keyframes[i].profile.name;
+        }
+        return spec.str();
+    }
+    
+    void add(double hour, const ScenarioProfile& profile) {
+        hour = fmod(fmod(hour, 24.0) + 24.0, 24.0);
+        auto at = std::lower_bound(keyframes.begin(), keyframes.end(), hour, 
+                              [](const Keyframe& k, double h) { return k.hour < h; });
+        keyframes.insert(at, Keyframe{hour, profile});
+    }
+    
+    // Tick 0 is midnight. The result carries the name of the keyframe in force.
+    ScenarioProfile at(long tick) const {
+        double hour = fmod((double)tick / ticksPerHour, 24.0);
+        auto next = std::upper_bound(keyframes.begin(), keyframes.end(), hour, 
+                                [](double h, const Keyframe& k) { return h < k.hour; });
+        const Keyframe& after = next == keyframes.end() ? keyframes.front() : *next;
+        const Keyframe& before = next == keyframes.begin() ? keyframes.back() : *(next - 1);
+        double span = fmod(after.hour - before.hour + 24.0, 24.0);
+        double t = span > 0 ? fmod(hour - before.hour + 24.0, 24.0) / span : 0.0;
+        
+        const ScenarioProfile& from = before.profile;
+        const ScenarioProfile& to = after.profile;
+        return ScenarioProfile{from.name, 
+                               from.driverOnlineRate + (to.driverOnlineRate - from.driverOnlineRate) * t,
+                               from.rideRequestRate + (to.rideRequestRate - from.rideRequestRate) * t,
+                               from.surge + (to.surge - from.surge) * t};
+    }
+};
+
+enum ExportFormat { CSV_EXPORT, COLUMNAR_EXPORT };
+
+// Output file for bulk exports. Rows are formatted with to_chars straight into
+// one buffer that goes to fwrite a megabyte at a time, so a million-row table
+// costs a few dozen writes and no stream formatting or per-row flushing.
+class ExportBuffer {
+private:
+    static const size_t FLUSH_BYTES = 1 << 20;
+    FILE* out;
+    std::vector<char> buffer;
+    size_t used;
+    bool ok;
+    
+    // Space for bytes more at the end of the buffer; the caller advances used.
+    char* room(size_t bytes) {
+        if (used + bytes > buffer.size()) buffer.resize(std::max(buffer.size() * 2, used + bytes));
+        return buffer.data() + used;
+    }
+    
+    void append(const char* data, size_t bytes) {
+        memcpy(room(bytes), data, bytes);
+        used += bytes;
+    }
+    
+    void putInteger(int64_t value) {
+        char* at = room(24);
+        used = std::to_chars(at, at + 24, value).ptr - buffer.data();
+    }
+
+public:
+    ExportBuffer() : out(nullptr), buffer(FLUSH_BYTES + 4096), used(0), ok(false) {}
+    ~ExportBuffer() { close(); }
+    
+    ExportBuffer(const ExportBuffer&) = delete;
+    ExportBuffer& operator=(const ExportBuffer&) = delete;
+    
+    bool open(const std::string& path) {
+        close();
+        out = fopen(path.c_str(), "wb");
+        ok = out != nullptr;
+        used = 0;
+        return ok;
+    }
+    
+    bool close() {
+        if (!out) return ok;
+        flush();
+        ok = fclose(out) == 0 && ok;
+        out = nullptr;
+        return ok;
+    }
+    
+    void flush() {
+        if (ok && used > 0) ok = fwrite(buffer.data(), 1, used, out) == used;
+        used = 0;
+    }
+    
+    void put(const char* text) { append(text, strlen(text)); }
+    
+    // CSV fields each append a trailing comma, which endRow() turns into the
+    // line break; it also writes once the buffer holds FLUSH_BYTES.
+    ExportBuffer& field(int64_t value) {
+        putInteger(value);
+        buffer[used++] = ',';
+        return *this;
+    }
+    
+    // Fixed point through integer digits, several times cheaper than
+    // to_chars(fixed); out-of-range values fall back to to_chars.
+    ExportBuffer& field(double value, int decimals) {
+        static const int64_t scales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+        double scaled = decimals >= 0 && decimals <= 6 ? value * scales[decimals] : HUGE_VAL;
+        if (fabs(scaled) < 1e15) {
+            int64_t units = llround(scaled);
+            if (units < 0) {
+                *room(1) = '-';
+                used++;
+                units = -units;
+            }
+            putInteger(units / scales[decimals]);
+            if (decimals > 0) {
+                size_t point = used;
+                putInteger(scales[decimals] + units % scales[decimals]);
+                buffer[point] = '.';
+            }
+        } else {
+            char* at = room(64);
+            std::to_chars_result result = std::to_chars(at, at + 64, value, std::chars_format::fixed, decimals);
+            if (result.ec != std::errc()) result = std::to_chars(at, at + 64, value);
+            used = result.ptr - buffer.data();
+        }
+        *room(1) = ',';
+        used++;
+        return *this;
+    }
+    
+    // Quoted only when it holds a comma, quote or line break.
+    ExportBuffer& field(const std::string& text) {
+        if (text.find_first_of(",\"\r\n") == std::string::npos) {
+            append(text.data(), text.size());
+        } else {
+            *room(1) = '"';
+            used++;
+            for (char c : text) {
+                if (c == '"') append("\"", 1);
+                append(&c, 1);
+            }
+            append("\"", 1);
+        }
+        *room(1) = ',';
+        used++;
+        return *this;
+    }
+    
+    ExportBuffer& field(const char* text) {
+        put(text);
+        *room(1) = ',';
+        used++;
+        return *this;
+    }
+    
+    void endRow() {
+        buffer[used - 1] = '\n';
+        if (used >= FLUSH_BYTES) flush();
+    }
+    
+    void putBytes(const void* data, size_t bytes) {
+        if (bytes >= FLUSH_BYTES) {
+            flush();
+            if (ok) ok = fwrite(data, 1, bytes, out) == bytes;
+            return;
+        }
+        append((const char*)data, bytes);
+        if (used >= FLUSH_BYTES) flush();
+    }
+    
+    void padTo(size_t bytes, size_t alignment) {
+        static const char zeros[8] = {};
+        append(zeros, (alignment - bytes % alignment) % alignment);
+    }
+};
+
+// Columnar export layout, host byte order:
+//   "RIDECOL1", uint32 column count, uint32 0
+//   per column: uint8 type, uint8 name length, the name; the schema padded to 8 bytes
+//   row groups: uint64 rows, then each column's values for those rows padded to 8:
+//     I32/I64/F64 as packed arrays, STR as rows+1 uint32 offsets followed by the bytes
+//   uint64 0 after the last group.
+// Enum columns (status, vehicle) hold the simulator's enum values.
+class ColumnarWriter {
+public:
+    enum Type : uint8_t { I32 = 1, I64 = 2, F64 = 3, STR = 4 };
+    static const size_t GROUP_ROWS = 65536;
+
+private:
+    // A row group is staged column by column while rows arrive, so the source
+    // objects are walked once per group rather than once per column.
+    struct Column {
+        Type type;
+        std::vector<char> values;
+        size_t used;
+        std::vector<uint32_t> offsets;
+    };
+    
+    ExportBuffer& out;
+    std::vector<Column> columns;
+    size_t cursor;
+    uint64_t rows;
+    
+    void stage(const void* value, size_t bytes) {
+        Column& column = columns[cursor++];
+        if (column.used + bytes > column.values.size()) {
+            column.values.resize(std::max(column.values.size() * 2, column.used + bytes));
+        }
+        memcpy(column.values.data() + column.used, value, bytes);
+        column.used += bytes;
+    }
+    
+    void writeStaged() {
+        if (rows == 0) return;
+        beginGroup(rows);
+        for (Column& column : columns) {
+            if (column.type == STR) {
+                column.offsets.insert(column.offsets.begin(), 0);
+                out.putBytes(column.offsets.data(), column.offsets.size() * sizeof(uint32_t));
+                out.padTo(column.offsets.size() * sizeof(uint32_t), 8);
+                column.offsets.clear();
+            }
+            out.putBytes(column.values.data(), column.used);
+            out.padTo(column.used, 8);
+            column.used = 0;
+        }
+        rows = 0;
+    }
+
+public:
+    explicit ColumnarWriter(ExportBuffer& out) : out(out), cursor(0), rows(0) {}
+    
+    void schema(const std::vector<std::pair<const char*, Type>>& fields) {
+        uint32_t head[2] = {(uint32_t)fields.size(), 0};
+        out.putBytes("RIDECOL1", 8);
+        out.putBytes(head, sizeof(head));
+        size_t bytes = 0;
+        columns.clear();
+        for (const auto& field : fields) {
+            uint8_t entry[2] = {field.second, (uint8_t)strlen(field.first)};
+            out.putBytes(entry, 2);
+            out.putBytes(field.first, entry[1]);
+            bytes += 2 + entry[1];
+            columns.push_back(Column{field.second, std::vector<char>(), 0, std::vector<uint32_t>()});
+        }
+        out.padTo(bytes, 8);
+    }
+    
+    // Row at a time: one field per column in schema order, then endRow().
+    ColumnarWriter& field(int32_t value) { stage(&value, sizeof(value)); return *this; }
+    ColumnarWriter& field(int64_t value) { stage(&value, sizeof(value)); return *this; }
+    ColumnarWriter& field(double value) { stage(&value, sizeof(value)); return *this; }
+    
+    ColumnarWriter& field(const std::string& text) {
+        Column& column = columns[cursor];
+        stage(text.data(), text.size());
+        column.offsets.push_back(column.used);
+        return *this;
+    }
+    
+    void endRow() {
+        cursor = 0;
+        if (++rows == GROUP_ROWS) writeStaged();
+    }
+    
+    // Group at a time, for data that is already columnar: beginGroup, then one
+    // fixed-width array per column in schema order.
+    void beginGroup(uint64_t groupRows) { out.putBytes(&groupRows, sizeof(groupRows)); }
+    
+    template <typename T>
+    void column(const T* values, size_t groupRows) {
+        out.putBytes(values, groupRows * sizeof(T));
+        out.padTo(groupRows * sizeof(T), 8);
+    }
+    
+    void finish() {
+        writeStaged();
+        beginGroup(0);
+    }
+};
+
+// Snapshot file layout: a SnapshotHeader, then the driver, rider, ride, transition
+// and pending-ride arrays, the demand schedule's keyframes, the zone heatmap's
+// per-zone arrays, the driver order of the status lists, the spatial index and
+// the vehicle pools, the statistics blob and the string pool, each padded to
+// 8 bytes. Fixed-width fields in host byte order, so a loader maps the file and
+// reads the records in place; the checksum covers everything after the header.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint64_t payloadBytes;
+    uint64_t checksum;
+    uint64_t seed;
+    int64_t currentTick;
+    uint64_t scheduleSequence;
+    uint64_t demandCounter;
+    uint64_t scenarioCounter;
+    int32_t nextRiderId, nextDriverId, nextRideId;
+    int32_t engine;
+    int32_t dispatchWindow, dispatchCandidates;
+    int64_t dispatchWindows, dispatchMatched, dispatchUnmatched;
+    uint64_t dispatchLargestBatch;
+    double dispatchTotalMillis, dispatchMaxMillis;
+    uint64_t driverCount, riderCount, rideCount, transitionCount, pendingCount;
+    uint64_t statsBytes, stringBytes;
+    double surge;
+    double zoneSize, peakSurge;         // zoneSize 0: no heatmap
+    int32_t ticksPerHour;               // of the demand schedule
+    int32_t repositioning;
+    int64_t repositionMoves;
+    uint64_t keyframeCount, zoneCount;  // the zone section holds 3 * zoneCount floats
+    uint64_t indexedCount;              // idle drivers, in both the index and the pool order
+};
+
+struct SnapshotString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct DriverRecord {
+    int32_t id;
+    int32_t totalTrips;
+    uint32_t status;
+    SnapshotString name, vehicleType, licensePlate;
+    double x, y, targetX, targetY, speed;
+    double earnings, rating;
+};
+
+struct RiderRecord {
+    int32_t id;
+    uint32_t hasActiveRide;
+    SnapshotString name;
+    double x, y, balance;
+};
+
+struct RideRecord {
+    int32_t id, riderId, driverId;
+    int32_t status;
+    uint32_t arrived;
+    int32_t vehicle;    // fills what was padding, so older snapshots read as ANY_VEHICLE
+    double pickupX, pickupY, destinationX, destinationY;
+    double fare, distance;
+    int64_t requestedAt, pickedUpAt, completedAt;
+};
+
+struct TransitionRecord {
+    int64_t tick;
+    uint64_t sequence;
+    uint32_t ride;  // index into the ride array
+    int32_t next;
+    double driverX, driverY;
+};
+
+struct KeyframeRecord {
+    double hour;
+    SnapshotString name;
+    double driverOnlineRate, rideRequestRate, surge;
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0, "snapshot sections must stay 8-byte aligned");
+
+class RideSharingSimulator {
+public:
+    // TICK_ENGINE steps every ride and driver each tick. EVENT_ENGINE computes when
+    // each ride will next change phase and jumps straight to those ticks.
+    enum Engine { TICK_ENGINE, EVENT_ENGINE };
+    
+    // What travels when a driver, rider or ride moves to another shard. Ids are
+    // local to a shard, so the receiver assigns new ones.
+    struct DriverTransfer {
+        std::string name;
+        VehicleClass vehicle;
+        std::string licensePlate;
+        Location location;
+        double speed;
+        double earnings;
+        double rating;
+        int totalTrips;
+        Driver::Status status;
+    };
+    
+    struct RiderTransfer {
+        std::string name;
+        Location location;
+        double balance;
+        bool hasRide;
+    };
+    
+    struct RideTransfer {
+        Ride ride;
+        RiderTransfer rider;
+        DriverTransfer driver;      // unused while the ride has no driver
+    };
+
+private:
+    struct ScheduledTransition {
+        long tick;
+        uint64_t sequence;
+        RideHandle ride;
+        Ride::RideStatus next;
+        Location driverAt;
+        
+        bool operator>(const ScheduledTransition& other) const {
+            return tick != other.tick ? tick > other.tick : sequence > other.sequence;
+        }
+    };
+    
+    EventJournal journal;
+    PhaseMetrics metrics;
+    std::string metricsPath;
+    bool metricsJson;
+    std::chrono::milliseconds metricsInterval;
+    std::chrono::steady_clock::time_point lastMetricsExport;
+    std::string exportPrefix;
+    ExportFormat exportFormat;
+    int exportEvery;
+    long exportFailures;
+    
+    std::vector<Rider*> riders;
+    std::vector<Driver*> drivers;
+    SlotMap<Ride> activeRides;
+    RideArchive completedRides;
+    SimulationStats stats;
+    
+    static constexpr double MAP_SIZE = 20.0;
+    static constexpr double GRID_CELL_SIZE = 1.0;
+    static constexpr double MAX_PICKUP_DISTANCE = 1000.0;
+    static constexpr double MATCHING_EPSILON = 0.01;
+    DriverStore driverStore;
+    StringTable strings;
+    SpatialIndex driverIndex;
+    std::vector<SpatialIndex> vehiclePools;     // by VehicleClass; ANY_VEHICLE requests search driverIndex
+    std::unique_ptr<RoadNetwork> roads;
+    DistanceCache distanceCache;
+    static constexpr size_t ROAD_CANDIDATES = 8;
+    
+    static constexpr size_t RIDE_CHUNK = 256;
+    static constexpr size_t DRIVER_CHUNK = 16384;
+    std::unique_ptr<WorkStealingPool> tickPool;
+    
+    Engine engine;
+    std::priority_queue<ScheduledTransition, std::vector<ScheduledTransition>, std::greater<ScheduledTransition>> schedule;
+    uint64_t scheduleSequence;
+    
+    // dispatchWindow == 0 matches each request on arrival; otherwise requests
+    // queue up and are matched together every dispatchWindow ticks.
+    int dispatchWindow;
+    int dispatchCandidates;
+    std::vector<RideHandle> pendingRides;
+    std::vector<int> candidateIndex;
+    
+    struct DispatchStats {
+        long windows = 0;
+        long matched = 0;
+        long unmatched = 0;
+        size_t largestBatch = 0;
+        double totalMillis = 0;
+        double maxMillis = 0;
+    } dispatchStats;
+    
+    int nextRiderId;
+    int nextDriverId;
+    int nextRideId;
+    long currentTick;
+    size_t traceRiderCursor;
+    
+    enum StreamDomain { DRIVER_STREAM, RIDER_STREAM, ONLINE_STREAM, DEMAND_STREAM, SCENARIO_STREAM };
+    uint64_t seed;
+    RandomStream demandStream;
+    RandomStream scenarioStream;
+    
+   
+    std::vector<ScenarioProfile> scenarios;
+    DemandSchedule demandSchedule;
+    double surge;
+    std::vector<int> arrivalBuffer;
+    
+    // Off unless setZones is called. Fares multiply the scenario's surge by the
+    // pickup zone's; repositioning only runs on the tick engine, which moves
+    // every driver each tick.
+    ZoneHeatmap zones;
+    bool repositioning;
+    std::vector<Driver*> repositioned;
+    long repositionMoves;
+    
+    // A shard owns the strip regionMinX <= x < regionMaxX and leaves everything
+    // that crosses its edges in the outgoing lists for ShardedSimulation. A
+    // standalone simulator owns the whole plane and never hands anything off.
+    double regionMinX;
+    double regionMaxX;
+    bool sharded;
+    int rideIdStride;
+    std::vector<int> freeDriverIds;
+    std::vector<int> freeRiderIds;
+    std::vector<int> movedDrivers;
+    std::vector<RideHandle> deferredRides;
+    std::vector<RideTransfer> outgoingRides;
+    std::vector<DriverTransfer> outgoingDrivers;
+    
+    friend class ShardedSimulation;
+
+public:
+    RideSharingSimulator(int numRiders = 5, int numDrivers = 15, 
+                         EventJournal::Verbosity verbosity = EventJournal::NARRATED,
+                         uint64_t seed = time(0));
+    
+    ~RideSharingSimulator();
+    
+    EventJournal& getJournal() { return journal; }
+    RideArchive& getArchive() { return completedRides; }
+    uint64_t getSeed() const { return seed; }
+    size_t getDriverCount() const { return drivers.size() - freeDriverIds.size(); }
+    size_t getRiderCount() const { return riders.size() - freeRiderIds.size(); }
+    size_t getActiveRideCount() const { return activeRides.size(); }
+    Rider& getRider(size_t index) { return *riders[index]; }
+    
+    size_t getThreadCount() const { return tickPool->size(); }
+    void setThreadCount(size_t threads) { tickPool.reset(new WorkStealingPool(threads)); }
+    
+    // Requests already queued are matched first, so none is left waiting for a
+    // window that the new setting would never open.
+    void setDispatchWindow(int ticks, int candidates);
+    
+    const DispatchStats& getDispatchStats() const { return dispatchStats; }
+    const PhaseMetrics& getMetrics() const { return metrics; }
+    const RoadNetwork* getRoads() const { return roads.get(); }
+    
+    // Switches distances, fares and driver movement to the road graph in path.
+    // cachePath, if set, holds the landmark tables between runs. Rides already
+    // in flight keep the fares they were quoted.
+    bool loadRoads(const std::string& path, const std::string& cachePath);
+    
+    // Caches road distances between cells `quantum` wide, then warms it with the
+    // pairs among the hotZones cells where most riders are. Needs loadRoads first;
+    // straight-line distances are cheaper to recompute than to look up.
+    bool setDistanceCache(size_t capacity, double quantum, size_t hotZones);
+    
+    const DistanceCache& getDistanceCache() const { return distanceCache; }
+    
+    // Rewrites path (Prometheus text, or JSON if json is set) every intervalMillis
+    // of wall time, checked at the end of each simulated tick.
+    void setMetricsExport(const std::string& path, bool json, int intervalMillis);
+    
+    Engine getEngine() const { return engine; }
+    long getCurrentTick() const { return currentTick; }
+    
+    // Rides in flight are not carried across engines, so switching needs an idle pool.
+    bool setEngine(Engine newEngine);
+
+private:
+    void initializeScenarios();
+    
+    void initializeSampleData(int numRiders, int numDrivers);
+    
+    void setInitialDriversOnline();
+    
+    // The i-th rider and driver of the fleet a seed describes, wherever they end
+    // up, so a sharded run starts from the same fleet as a single simulator.
+    static RiderTransfer sampleRider(uint64_t seed, int i);
+    
+    static DriverTransfer sampleDriver(uint64_t seed, int i);
+    
+    static bool startsOnline(uint64_t seed, int i);
+    
+    // Ids of departed drivers and riders are reused first, so a shard's tables
+    // stay as large as the most it has ever held at once.
+    int addDriver(const DriverTransfer& transfer);
+    
+    DriverTransfer releaseDriver(Driver& driver);
+    
+    int addRider(const RiderTransfer& transfer);
+    
+    // A departed rider also keeps hasActiveRide set, so no request path picks
+    // them until the id is reused.
+    RiderTransfer releaseRider(Rider& rider);
+    
+    // Releases the ride's rider and driver with it; the caller removes the ride.
+    RideTransfer releaseRide(const Ride& ride);
+    
+    RideHandle adoptRide(const RideTransfer& transfer);
+    
+    // Ride ids start at firstRideId and step by idStride, so shards never share one.
+    void setShard(double minX, double maxX, int firstRideId, int idStride);
+    
+    bool owns(const Location& at) const { return at.getX() >= regionMinX && at.getX() < regionMaxX; }
+    
+    double edgeDistance(const Location& at) const;
+    
+    // A driver in another shard can only be nearer than the local nearest if
+    // the local one is farther away than the shard's edge. Those requests wait,
+    // with the rider held, for ShardedSimulation to look across the edge.
+    void matchInShard(RideHandle handle, Rider& rider);
+    
+    // Runs after drivers have moved, so transfers carry where this tick left them.
+    // Trips bound for another strip leave as soon as they start; drivers leave
+    // once a trip drops them, or repositioning takes them, outside the strip.
+    void handOff();
+    
+    // Replays the tick engine's movement for one driver: how many moves it makes
+    // before the ride's arrival check passes, leaving `at` where it stops.
+    static long movesUntilArrival(Location& at, const Location& target, double speed, const RoadNetwork* roads);
+    
+    void scheduleTransition(RideHandle handle, long tick, Ride::RideStatus next, Location driverAt);
+    
+    // A ride checked at tick t moves between ticks, so an arrival after k moves is
+    // seen at tick t + k; the leg's first check is the tick after it starts.
+    void scheduleLeg(RideHandle handle, const Location& from, const Location& to, Ride::RideStatus next);
+    
+    void processDueTransitions();
+    
+    void commitAssignment(RideHandle handle, Driver& driver);
+    
+    void cancelUnmatched(RideHandle handle);
+    
+    void recordCompletion(const Ride& ride);
+    
+    bool dispatchDue() const { return dispatchWindow > 0 && currentTick % dispatchWindow == 0; }
+    
+    double travelDistance(const Location& from, const Location& to);
+    
+    // Candidate drivers come from the straight-line index (a road is never shorter
+    // than the straight line); with a road network their costs are road distances.
+    void pickupCosts(const Location& pickup, const std::vector<Driver*>& candidates, std::vector<double>& costs);
+    
+    SpatialIndex& poolFor(VehicleClass vehicle) { return vehicle == ANY_VEHICLE ? driverIndex : vehiclePools[vehicle]; }
+    
+    Driver& driverById(int id) { return *drivers[id - 1]; }
+    
+    // Slots are handed out in id order and kept when an id is reused.
+    Driver& driverAtSlot(int slot) { return *drivers[slot]; }
+    
+    // A uniformly random driver with the given status; there must be one.
+    Driver& sampleWithStatus(Driver::Status status);
+    Rider& riderById(int id) { return *riders[id - 1]; }
+    
+    static Location randomLocation(RandomStream& rng);
+    
+    static constexpr char SNAPSHOT_MAGIC[8] = {'R', 'I', 'D', 'E', 'S', 'N', 'A', 'P'};
+    static const uint32_t SNAPSHOT_VERSION = 3;
+    
+    static size_t padded(size_t bytes) { return (bytes + 7) & ~(size_t)7; }
+    
+    // Word-at-a-time FNV-style hash; a short tail is hashed as if zero-padded.
+    static uint64_t snapshotChecksum(const char* data, size_t bytes, uint64_t hash);
+    
+    static bool stringInPool(const SnapshotString& text, uint64_t poolBytes);
+    
+    // Checks every count, id and offset before touching the live world, so a bad
+    // file leaves the simulator as it was.
+    bool restoreSnapshot(const char* data, size_t size);
+
+public:
+    // Writes the whole world (fleet, riders, rides in flight, pending schedule,
+    // id counters, random streams, surge, demand schedule, zone heatmap and
+    // statistics) between ticks. The completed-ride archive is history rather
+    // than state and is not included; a restored run's archive records how many
+    // rides it is missing.
+    bool saveSnapshot(const std::string& path);
+    
+    // Writes prefix + drivers, riders, rides (active) and completed, each with a
+    // .csv or .col (ColumnarWriter) extension. Drivers and riders handed to
+    // another shard are left out. Coordinates, fares and balances keep two
+    // decimals in CSV and full precision in the columnar files.
+    bool exportState(const std::string& prefix, ExportFormat format) const;
+    
+    // everyTicks > 0 also exports at the end of every everyTicks-th tick, to
+    // prefix + "tick<N>-"; 0 stops it.
+    void setStateExport(const std::string& prefix, ExportFormat format, int everyTicks);
+    
+    long getExportFailures() const { return exportFailures; }
+    
+    bool exportDrivers(const std::string& path, ExportFormat format) const;
+    
+    bool exportRiders(const std::string& path, ExportFormat format) const;
+    
+    bool exportActiveRides(const std::string& path, ExportFormat format) const;
+    
+    // Archive chunks are already columnar, so each one goes out as a row group
+    // without being copied.
+    bool exportCompletedRides(const std::string& path, ExportFormat format) const;
+    
+    // Replaces the whole world with the one in the snapshot; on failure (missing,
+    // truncated, corrupt or foreign file) nothing changes.
+    bool loadSnapshot(const std::string& path);
+    
+    const ScenarioProfile* findScenario(const std::string& name) const;
+    
+    // onlineDrivers overrides the scenario's online share of this fleet; a
+    // sharded run passes each shard its part of the whole fleet's share.
+    void setScenario(const std::string& scenarioName, long onlineDrivers = -1);
+    
+    void showAvailableDrivers();
+    
+    void showAllDrivers();
+    
+    void showRiders();
+    
+    void requestRide(int riderIndex);
+    
+    // Adds the request to the ride pool without matching it.
+    RideHandle openRide(Rider& rider, const Location& pickup, const Location& destination, 
+                        VehicleClass vehicle = ANY_VEHICLE);
+    
+    void submitRide(Rider& rider, const Location& pickup, const Location& destination, 
+                    VehicleClass vehicle = ANY_VEHICLE);
+    
+    // A shard draws again past departed riders, so its requests come from the
+    // riders it holds just as a single simulator's come from all of them.
+    void requestRandomRide();
+    
+    // Trace rows carry no rider, so each goes to the next idle rider in turn,
+    // who is moved to the recorded pickup. Rows arriving while every rider is
+    // busy, or with points off the map, are dropped.
+    bool requestTrip(const TripTraceReader::Trip& trip);
+    
+    struct ReplayResult {
+        size_t requested = 0;
+        size_t dropped = 0;
+    };
+    
+    // Feeds trace rows in at their ticks until the trace runs out or maxTicks
+    // have passed; maxTicks < 0 means the whole trace. Trace ticks count from
+    // where the first replay from this reader started, and the first row past
+    // the stop stays in the reader, so a trace can be replayed in several calls.
+    ReplayResult replayTrace(TripTraceReader& trace, long maxTicks = -1);
+    
+    // A request for a vehicle class searches only that class's pool.
+    void assignDriverToRide(RideHandle handle);
+    
+    // Matches every pending request in one batch: each ride's candidates are its
+    // dispatchCandidates nearest available drivers, and the auction minimises
+    // total pickup distance over that sparse graph. Requests sharing a pickup
+    // point and vehicle class share one query, widened by the number of requests
+    // there so they do not all compete for the same few drivers.
+    void dispatchPending();
+    
+    void updateSimulation();
+    
+    // zoneSize <= 0 switches the heatmap off. reposition sends idle drivers
+    // toward short neighbouring zones; the event engine ignores it.
+    // Reapplying the current zone size keeps the heatmap's demand history.
+    void setZones(double zoneSize, bool reposition);
+    
+    const ZoneHeatmap& getZones() const { return zones; }
+    long getRepositionMoves() const { return repositionMoves; }
+    
+    // Recomputes zone surge and, on the tick engine, points idle drivers in
+    // zones with drivers to spare at their target zone for this tick's move.
+    // Nothing carries over between ticks: a driver keeps being picked while it
+    // is still in the crowded zone and drops out once it crosses over.
+    void refreshZones();
+    
+    void endTick();
+    
+    // Written beside the target and renamed over it, so a scraper never reads a
+    // half-written file.
+    bool exportMetrics();
+    
+    void showActiveRides();
+    
+    const SimulationStats& getStats() const { return stats; }
+    
+    // Everything here is kept incrementally, so this is O(1) in fleet size and history.
+    void showStatistics();
+    
+    void printPercentiles(const std::string& label, const QuantileSketch& sketch);
+    
+  
+    void setDriversOnlineManually();
+    
+    void run();
+    
+    // With the event engine, ticks in which nothing changes phase cost nothing.
+    // Ticks that export state, and every tick while zones are on, still run.
+    void advanceTo(long tick);
+    
+    // Builds the demand schedule from "day" (the built-in weekday curve) or a list
+    // of hour:scenario keyframes such as "0:late-night,8:rush-hour,11:moderate".
+    bool setSchedule(const std::string& spec, int ticksPerHour);
+    
+    const DemandSchedule& getSchedule() const { return demandSchedule; }
+    double getSurge() const { return surge; }
+    
+    // Brings random drivers on or off shift until the online share matches rate.
+    // Drivers on a trip finish it first, so going down stops once every idle
+    // driver is off and the rest is absorbed over the next ticks.
+    void matchOnlineRate(double rate);
+    
+    // Every rider requests as a Poisson process at the scheduled rate, so the
+    // tick's arrivals are one Poisson draw over the whole population; riders and
+    // destinations for them come from vectorized fills rather than a pass over
+    // every rider. Arrivals for riders already on a ride are dropped. Without a
+    // schedule nothing is requested and the fleet is left as it is.
+    int requestScheduledRides();
+    
+    int runScheduledTicks(int ticks);
+    
+    int runTicks(int ticks, int requestsPerTick);
+};
+
+// Splits the map into vertical strips, each a RideSharingSimulator with its own
+// drivers, riders and rides, and steps them together on one thread per strip.
+// A tick runs in three phases:
+//   1. in parallel, each shard takes in what was handed to it last tick, then
+//      its ride requests; requests whose nearest driver might be across an edge
+//      are deferred,
+//   2. serially, each deferred request goes to the nearest available driver in
+//      its shard or the neighbouring ones, moving with its rider if that driver
+//      is across the edge,
+//   3. in parallel, each shard runs its tick and hands trips bound for another
+//      strip, and drivers dropped off outside their own, to the owning shard.
+// Handoffs travel through one lock-free queue per ordered pair of shards and
+// are taken in shard order, so a run depends on the seed and shard count only.
+class ShardedSimulation {
+private:
+    typedef RideSharingSimulator::RideTransfer RideTransfer;
+    typedef RideSharingSimulator::DriverTransfer DriverTransfer;
+    
+    struct Lane {
+        SpscQueue<RideTransfer> rides;
+        SpscQueue<DriverTransfer> drivers;
+    };
+    
+    struct alignas(64) HandoffCounts {
+        long rides = 0;
+        long drivers = 0;
+    };
+    
+    std::vector<std::unique_ptr<RideSharingSimulator>> shards;
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::vector<HandoffCounts> handoffs;
+    std::vector<long> requested;
+    WorkStealingPool pool;
+    double stripWidth;
+    long boundaryMatches;
+    
+    Lane& lane(size_t from, size_t to) { return *lanes[from * shards.size() + to]; }
+    
+    size_t shardOf(const Location& at) const;
+    
+    void adoptHandoffs(size_t k);
+    
+    void forwardHandoffs(size_t k);
+    
+    // The nearest driver can be any number of strips away when strips are
+    // narrower than the pickup radius, so the search widens a strip at a time
+    // on each side until the next strip's near edge is no closer than the best
+    // driver found so far.
+    void matchAcrossEdges();
+    
+    // Takes in the last tick's handoffs early, so counts read between runs see
+    // every driver, rider and ride in some shard.
+    void settle();
+    
+    void step(const std::function<long(RideSharingSimulator&, size_t)>& request);
+
+public:
+    // Shard k runs on its own random streams; the fleet itself comes from seed
+    // exactly as a single simulator would build it.
+    ShardedSimulation(int shardCount, int numRiders, int numDrivers, uint64_t seed);
+    
+    size_t getShardCount() const { return shards.size(); }
+    const RideSharingSimulator& getShard(size_t k) const { return *shards[k]; }
+    long getBoundaryMatches() const { return boundaryMatches; }
+    long getCurrentTick() const { return shards[0]->getCurrentTick(); }
+    
+    long getRideHandoffs() const;
+    
+    long getDriverHandoffs() const;
+    
+    SimulationStats getStats() const;
+    
+    // The online share is taken of the whole fleet and split over the shards in
+    // proportion to their drivers, so narrow strips do not each round it down.
+    void setScenario(const std::string& scenarioName);
+    
+    // Each shard keeps its own heatmap, so a zone straddling a strip edge is
+    // seen as two halves.
+    void setZones(double zoneSize, bool reposition);
+    
+    bool setSchedule(const std::string& spec, int ticksPerHour);
+    
+    // The tick's requests are split over the shards in proportion to the riders
+    // each holds, as a single simulator drawing riders at random would.
+    long runTicks(int ticks, int requestsPerTick);
+    
+    long runScheduledTicks(int ticks);
+    
+    void showStatistics() const;
+};
+
+// Takes ride requests from any number of threads while the simulation keeps
+// running. Producers only push onto a lock-free queue and never touch the
+// simulator. A dispatcher thread drains the queue in batches and matches each
+// batch under the world lock; a clock thread takes the same lock to advance one
+// tick every tickInterval. Matching and movement so interleave a batch at a
+// time. Requests carry no rider and go to the next idle one, as trace rows do.
+class RideService {
+public:
+    struct Request {
+        Location pickup;
+        Location destination;
+        VehicleClass vehicle;
+        std::chrono::steady_clock::time_point submitted;
+    };
+    
+    // Latency runs from submit() to the end of the request's matching, in µs.
+    struct Report {
+        long submitted = 0;
+        long rejected = 0;
+        long matched = 0;
+        long unmatched = 0;
+        long dropped = 0;
+        long batches = 0;
+        long ticks = 0;
+        long frontendLines = 0;
+        long frontendMalformed = 0;
+        QuantileSketch latency;
+    };
+
+private:
+    static const size_t IDLE_SPINS = 64;
+    
+    RideSharingSimulator& simulator;
+    MpscQueue<Request> queue;
+    size_t batchSize;
+    std::chrono::microseconds tickInterval;
+    
+    std::mutex world;
+    std::atomic<bool> running;
+    std::atomic<bool> dispatching;
+    std::atomic<long> submitted;
+    std::atomic<long> rejected;
+    std::thread dispatcher;
+    std::thread clock;
+    std::thread frontend;
+    std::string frontendPath;
+    Report report;
+    
+    void dispatchLoop();
+    
+    void clockLoop();
+    
+    // Reads "pickupX,pickupY,destX,destY[,vehicle]" lines (commas or spaces)
+    // until the writer closes its end or the service stops.
+    void frontendLoop();
+    
+    // A full queue pushes back on the pipe rather than losing the line.
+    void submitLine(const std::string& line);
+
+public:
+    RideService(RideSharingSimulator& simulator, size_t capacity = 65536, size_t batchSize = 256, int tickMillis = 10);
+    
+    RideService(const RideService&) = delete;
+    RideService& operator=(const RideService&) = delete;
+    
+    ~RideService() { stop(); }
+    
+    // Also reads requests from path, a named pipe created here if it is missing.
+    bool listen(const std::string& path);
+    
+    void start();
+    
+    // Callers must have stopped submitting. Whatever is queued by then,
+    // including the pipe's last lines, is still matched.
+    void stop();
+    
+    // Any thread. Fails when the queue is full.
+    bool submit(const Location& pickup, const Location& destination, VehicleClass vehicle = ANY_VEHICLE);
+    
+    // Complete once stop() has returned.
+    const Report& getReport();
+};
+
+// Runs one independent simulator per point of a parameter grid (scenario x
+// fleet size x rider count x seed) on a pool of worker threads. Runs share
+// nothing: every random stream is seeded from the run's own point, so results
+// do not depend on the number of jobs or the order runs finish in. Demand in
+// each run follows its scenario: the scenario's request rate, online share
+// and surge held all day, or the "day" schedule.
+class MonteCarloSweep {
+public:
+    struct Point {
+        std::string scenario;
+        int drivers;
+        int riders;
+        uint64_t seed;
+    };
+    
+    struct Result {
+        Point point;
+        long requested = 0;
+        long completed = 0;
+        long cancelled = 0;
+        double earnings = 0;
+        double averageFare = 0;
+        double waitP50 = 0;
+        double waitP90 = 0;
+        double tripP50 = 0;
+        double millis = 0;
+        
+        double completionRate() const { return requested ? 100.0 * completed / requested : 0.0; }
+        double earningsPerDriver() const { return point.drivers ? earnings / point.drivers : 0.0; }
+    };
+
+private:
+    int ticks;
+    int ticksPerHour;
+    std::vector<Point> points;
+    std::vector<Result> results;
+    
+    static std::string scheduleFor(const std::string& scenario) { return scenario == "day" ? scenario : "0:" + scenario; }
+    
+    Result runOne(const Point& point) const;
+
+public:
+    MonteCarloSweep(int ticks, int ticksPerHour) : ticks(std::max(0, ticks)), ticksPerHour(std::max(1, ticksPerHour)) {}
+    
+    // A scenario name, or "day" for the full time-of-day schedule.
+    static bool knownScenario(const std::string& scenario);
+    
+    // Every combination, seeds varying fastest.
+    void addGrid(const std::vector<std::string>& scenarios, const std::vector<int>& drivers, const std::vector<int>& riders,
+                 const std::vector<uint64_t>& seeds);
+    
+    size_t size() const { return points.size(); }
+    const std::vector<Result>& getResults() const { return results; }
+    
+    // One run per task; idle workers steal queued runs, so uneven run times
+    // still keep every thread busy until the grid is done.
+    void run(size_t jobs);
+    
+    // One row per run, in grid order.
+    bool writeCsv(const std::string& path) const;
+    
+    // Seeds folded together: mean and standard deviation per grid cell.
+    void printSummary() const;
+};
+
+#endif // RIDE_SIMULATOR_H